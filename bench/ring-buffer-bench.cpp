@@ -0,0 +1,56 @@
+// Compares the mutex based CircularBuffer with the lock-free SpscRingBuffer
+// for one producer thread and one consumer thread passing unique_ptrs, the same
+// way AVPacketSource hands packets to a subscriber.
+#include "common/circular-buffer.hpp"
+#include "common/spsc-ring-buffer.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+   typedef std::unique_ptr<int> Item;
+
+   template <typename Queue>
+   double run(uint32_t capacity, int count) {
+      Queue queue(capacity);
+      std::vector<Item> items;
+      items.reserve(count);
+      for (int i = 0; i < count; i++) {
+         items.emplace_back(new int(i));
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      std::thread consumer([&]() {
+         int received = 0;
+         while (received < count) {
+            auto item = queue.pop_back();
+            if (!item) {
+               std::this_thread::yield();
+               continue;
+            }
+            received++;
+         }
+      });
+      for (auto& item : items) {
+         queue.push_front(item);
+      }
+      consumer.join();
+      auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+      return count / elapsed.count();
+   }
+}  // namespace
+
+int main(int argc, char* argv[]) {
+   int count = argc > 1 ? atoi(argv[1]) : 2000000;
+   uint32_t capacities[] = {50, 1024};
+   for (auto capacity : capacities) {
+      auto locked = run<common::CircularBuffer<Item>>(capacity, count);
+      auto lockFree = run<common::SpscRingBuffer<Item>>(capacity, count);
+      printf("capacity %4u: CircularBuffer %12.0f ops/s, SpscRingBuffer %12.0f ops/s (x%.1f)\n",
+             capacity, locked, lockFree, lockFree / locked);
+   }
+   return 0;
+}
@@ -0,0 +1,127 @@
+#include "audio-rate-counter.hpp"
+#include <spdlog/spdlog.h>
+
+namespace challenge { namespace media {
+
+   AudioRateCounter::AudioRateCounter(int durationMS, OverflowPolicy policy)
+      : PacketSourceSubscriber(100, policy)
+      , m_isStarted(false)
+      , m_needToStop(false)
+      , m_isReady(false)
+      , m_hasLastPacket(false)
+      , m_expectedTime(0)
+      , m_lastPacketTime(0)
+      , m_lastReportTime(0)
+      , m_sampleRate(0)
+      , m_frameSize(0)
+      , m_streamBaseTime(AVRational{1, 1000})
+      , m_discontinuities(0)
+      , m_packetRate(int64_t(durationMS) * 1000)
+      , m_packetSamples(100) {}
+
+   AudioRateCounter::~AudioRateCounter() {}
+
+   bool AudioRateCounter::Setup(const AVPacketSource* source) {
+      auto audioStream = source->AudioStream();
+      RequestMediaType(AVMEDIA_TYPE_AUDIO);
+      if (audioStream == nullptr) {
+         spdlog::info("no audio stream to count");
+         return false;
+      }
+      m_streamBaseTime = audioStream->time_base;
+      m_sampleRate = audioStream->codecpar->sample_rate;
+      m_frameSize = audioStream->codecpar->frame_size;
+      m_isReady = true;
+      spdlog::info("setupping audio rate counter, {} Hz", m_sampleRate);
+      return true;
+   }
+
+   void AudioRateCounter::Start() {
+      if (m_isStarted || !m_isReady) {
+         return;
+      }
+      m_needToStop = false;
+      m_hasLastPacket = false;
+      m_packetRate.Reset();
+      m_packetSamples.clear();
+      m_readThrd.start([&]() { readLoop(); });
+   }
+
+   void AudioRateCounter::Stop() {
+      m_needToStop = true;
+      WakeReader();
+      m_readThrd.join();
+      m_isStarted = false;
+   }
+
+   void AudioRateCounter::readLoop() {
+      m_isStarted = true;
+      spdlog::info("audio rate counter started");
+      while (!m_needToStop) {
+         auto pkt = ReadPacket(READ_TIMEOUT_MS);
+         if (!pkt || !pkt->HasFlag(PacketFlags::AudioPacket)) {
+            continue;
+         }
+         countPacket(pkt);
+      }
+      m_isStarted = false;
+   }
+
+   void AudioRateCounter::countPacket(const Packet::Ptr& pkt) {
+      if (pkt->PTS() == AV_NOPTS_VALUE) {
+         return;
+      }
+      AVRational microseconds = AVRational{1, 1000000};
+      auto time = av_rescale_q(pkt->PTS(), m_streamBaseTime, microseconds);
+      int64_t samples = m_frameSize;
+      if (pkt->Duration() > 0 && m_sampleRate > 0) {
+         samples = av_rescale_q(pkt->Duration(), m_streamBaseTime, AVRational{1, m_sampleRate});
+      }
+      auto duration = pkt->Duration() > 0 ? av_rescale_q(pkt->Duration(), m_streamBaseTime, microseconds)
+                      : m_sampleRate > 0  ? samples * 1000000 / m_sampleRate
+                                          : 0;
+
+      if (m_hasLastPacket) {
+         auto gap = time - m_expectedTime;
+         m_gaps.Record(uint64_t(gap < 0 ? -gap : gap));
+         // more than half a packet off can not be rounding any more
+         if (duration > 0 && (gap > duration / 2 || gap < -duration / 2)) {
+            m_discontinuities++;
+            spdlog::warn("audio is not continuous, {:.1f} ms {}", (gap < 0 ? -gap : gap) / 1000.0,
+                         gap > 0 ? "missing" : "overlapping");
+         }
+         if (time < m_lastPacketTime || (duration > 0 && gap < -duration / 2)) {
+            // the rate window needs times in order, any step back past the overlap a rounding
+            // error explains starts it over
+            m_packetRate.Reset();
+            m_lastReportTime = time;
+         }
+      } else {
+         m_lastReportTime = time;
+      }
+      m_hasLastPacket = true;
+      m_lastPacketTime = time;
+      m_expectedTime = time + duration;
+      m_packetRate.Add(time);
+      m_packetSamples.Add(samples);
+
+      if (time - m_lastReportTime >= m_packetRate.Window()) {
+         m_lastReportTime = time;
+         spdlog::info("audio: {:.1f} packets/s, {:.0f} samples/s, gap p95 {:.2f} max {:.2f} ms, {} discontinuities",
+                      PacketsPerSecond(), SamplesPerSecond(), GapPercentile(0.95), m_gaps.Max() / 1000.0,
+                      Discontinuities());
+      }
+   }
+
+   double AudioRateCounter::PacketsPerSecond() const {
+      return m_packetRate.Rate() * 1000000;
+   }
+
+   double AudioRateCounter::SamplesPerSecond() const {
+      return m_packetSamples.Mean() * PacketsPerSecond();
+   }
+
+   double AudioRateCounter::GapPercentile(double q) const {
+      return m_gaps.Percentile(q) / 1000.0;
+   }
+}}  // namespace challenge::media
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "packet-source.hpp"
+#include "packet-source-subscriber.hpp"
+#include "common/log-histogram.hpp"
+#include "common/rolling-stats.hpp"
+#include "common/sliding-window-rate.hpp"
+
+namespace challenge { namespace media {
+
+   // Watches the continuity of the audio stream from packet metadata alone, nothing is decoded.
+   // Packets and samples per second come from the packet timestamps and durations, the gap
+   // between where a packet starts and where the previous one ended shows dropped or
+   // overlapping audio.
+   class AudioRateCounter : public media::PacketSourceSubscriber {
+    public:
+      AudioRateCounter(int durationMS, OverflowPolicy policy = OverflowPolicy::Block);
+      ~AudioRateCounter();
+
+      virtual std::string ObjectName() override {
+         return "AudioRateCounter";
+      }
+
+      virtual bool Setup(const AVPacketSource* source) override;
+
+      void Start();
+      void Stop();
+
+      // all of them can be read from any thread while the counter is running
+      double PacketsPerSecond() const;
+      double SamplesPerSecond() const;
+      // gap (or overlap) between consecutive packets in milliseconds
+      double GapPercentile(double q) const;
+      uint64_t Discontinuities() const {
+         return m_discontinuities;
+      }
+
+    protected:
+      bool isStopping() const override {
+         return m_needToStop;
+      }
+
+    private:
+      static const int READ_TIMEOUT_MS = 500;
+
+      void readLoop();
+      void countPacket(const Packet::Ptr& pkt);
+
+      bool m_isStarted;
+      std::atomic<bool> m_needToStop;
+      bool m_isReady;
+      bool m_hasLastPacket;
+      // stream time in microseconds
+      int64_t m_expectedTime;
+      int64_t m_lastPacketTime;
+      int64_t m_lastReportTime;
+      int m_sampleRate;
+      int m_frameSize;
+      AVRational m_streamBaseTime;
+      std::atomic<uint64_t> m_discontinuities;
+      common::SlidingWindowRate m_packetRate;
+      common::RollingStats<int64_t> m_packetSamples;
+      common::LogHistogram m_gaps;
+      common::async::Thread m_readThrd;
+   };
+
+}}  // namespace challenge::media
@@ -63,11 +63,13 @@ namespace common {
 
       T mean() const {
 			std::unique_lock<std::mutex> lock(m_mutex);
+			if (m_queue.empty())
+				return T{};
 			T sum = 0;
 			for (auto i:m_queue) {
 				sum+=i;
 			}
-			return sum/m_capacity;
+			return sum/T(m_queue.size());
 		}
 
     private:
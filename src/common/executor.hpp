@@ -0,0 +1,26 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+
+namespace common { namespace async {
+
+   // Something that runs small tasks on threads it owns.
+   // Components that would otherwise sit in a loop on their own thread post a step of work
+   // instead and post the next step when it is done, so many of them share a few threads.
+   class Executor {
+    public:
+      typedef std::function<void()> Task;
+
+      virtual ~Executor() {}
+
+      virtual void Post(Task task) = 0;
+      // runs task once delayMS milliseconds have passed, for polling without sleeping a worker
+      virtual void PostAfter(int delayMS, Task task) = 0;
+
+      virtual size_t WorkerCount() const = 0;
+   };
+
+   typedef std::shared_ptr<Executor> ExecutorPtr;
+
+}}  // namespace common::async
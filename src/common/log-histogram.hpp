@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include "config.hpp"
+
+namespace common {
+   // Fixed memory histogram for non-negative values with a bounded relative error.
+   // Values below SUB_BUCKETS get a bucket of their own, above that every power of two is split
+   // into SUB_BUCKETS linear buckets, so a reported percentile is within 1/SUB_BUCKETS of the
+   // real one. Values from 2^MAX_BITS on land in the last bucket, Max() stays exact.
+   // Buckets are relaxed atomics: Record() never locks and the percentile queries can run on
+   // any thread while the writer keeps going, they just see a slightly older picture.
+   class LogHistogram {
+    public:
+      static const int SUB_BITS = 4;
+      static const int SUB_BUCKETS = 1 << SUB_BITS;
+      static const int MAX_BITS = 40;
+      static const int BUCKET_COUNT = (MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS;
+
+      LogHistogram() {
+         Reset();
+      }
+
+      void Record(uint64_t value) {
+         m_buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+         m_count.fetch_add(1, std::memory_order_relaxed);
+         auto max = m_max.load(std::memory_order_relaxed);
+         while (value > max &&
+                !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+         }
+      }
+
+      // q in [0, 1], the upper bound of the bucket holding that share of the values
+      uint64_t Percentile(double q) const {
+         uint64_t total = 0;
+         uint64_t counts[BUCKET_COUNT];
+         for (int i = 0; i < BUCKET_COUNT; i++) {
+            counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+            total += counts[i];
+         }
+         if (total == 0) {
+            return 0;
+         }
+         auto rank = uint64_t(q * double(total) + 0.5);
+         if (rank < 1) {
+            rank = 1;
+         }
+         uint64_t seen = 0;
+         for (int i = 0; i < BUCKET_COUNT; i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+               auto upper = upperBoundOf(i);
+               auto max = Max();
+               return upper < max ? upper : max;
+            }
+         }
+         return Max();
+      }
+
+      uint64_t Max() const {
+         return m_max.load(std::memory_order_relaxed);
+      }
+
+      uint64_t Count() const {
+         return m_count.load(std::memory_order_relaxed);
+      }
+
+      // not safe against a concurrent Record(), call it from the writer
+      void Reset() {
+         for (auto& bucket : m_buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+         }
+         m_count.store(0, std::memory_order_relaxed);
+         m_max.store(0, std::memory_order_relaxed);
+      }
+
+    private:
+      static int bucketOf(uint64_t value) {
+         if (value < uint64_t(SUB_BUCKETS)) {
+            return int(value);
+         }
+         int msb = 63 - __builtin_clzll(value);
+         if (msb >= MAX_BITS) {
+            return BUCKET_COUNT - 1;
+         }
+         int shift = msb - SUB_BITS;
+         return (shift + 1) * SUB_BUCKETS + int((value >> shift) & (SUB_BUCKETS - 1));
+      }
+
+      static uint64_t upperBoundOf(int bucket) {
+         if (bucket < SUB_BUCKETS) {
+            return uint64_t(bucket);
+         }
+         int shift = bucket / SUB_BUCKETS - 1;
+         uint64_t lower = uint64_t(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+         return lower + (uint64_t(1) << shift) - 1;
+      }
+
+      std::atomic<uint64_t> m_buckets[BUCKET_COUNT];
+      std::atomic<uint64_t> m_count;
+      std::atomic<uint64_t> m_max;
+   };
+
+}  // namespace common
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "config.hpp"
+
+namespace common {
+   // Mean, variance, min and max of the last capacity values, each query in O(1).
+   // Sum and sum of squares are updated as values enter and leave the ring and recomputed from
+   // scratch once per lap so floating point error can not pile up. Min and max come from
+   // monotonic queues, amortized O(1) per value.
+   // Add() belongs to a single writer. After every Add() the results are published under a
+   // sequence lock, readers on other threads never block the writer, they retry in the rare
+   // case they raced with an update.
+   template <typename T>
+   class RollingStats {
+    public:
+      struct Snapshot {
+         uint32_t count;
+         double sum;
+         double sumOfSquares;
+         T min;
+         T max;
+
+         double Mean() const {
+            return count > 0 ? sum / count : 0.0;
+         }
+
+         // population variance of the values in the window
+         double Variance() const {
+            if (count == 0) {
+               return 0.0;
+            }
+            auto mean = Mean();
+            auto variance = sumOfSquares / count - mean * mean;
+            return variance > 0.0 ? variance : 0.0;
+         }
+
+         double StdDev() const {
+            return std::sqrt(Variance());
+         }
+
+         // for interval samples, events per unit of time
+         double Rate() const {
+            return sum > 0.0 ? count / sum : 0.0;
+         }
+      };
+
+      RollingStats(uint32_t cap)
+          : m_capacity(cap == 0 ? 1 : cap)
+          , m_next(0)
+          , m_count(0)
+          , m_added(0)
+          , m_sum(0.0)
+          , m_sumOfSquares(0.0)
+          , m_seq(0) {
+         m_values.resize(m_capacity);
+         publish();
+      }
+
+      void Add(T value) {
+         if (m_count == m_capacity) {
+            double old = double(m_values[m_next]);
+            m_sum -= old;
+            m_sumOfSquares -= old * old;
+         } else {
+            m_count++;
+         }
+         m_values[m_next] = value;
+         m_sum += double(value);
+         m_sumOfSquares += double(value) * double(value);
+         if (++m_next == m_capacity) {
+            m_next = 0;
+            recomputeSums();
+         }
+
+         auto index = m_added++;
+         auto oldest = m_added - m_count;
+         while (!m_minQueue.empty() && m_minQueue.back().second >= value) {
+            m_minQueue.pop_back();
+         }
+         m_minQueue.emplace_back(index, value);
+         while (m_minQueue.front().first < oldest) {
+            m_minQueue.pop_front();
+         }
+         while (!m_maxQueue.empty() && m_maxQueue.back().second <= value) {
+            m_maxQueue.pop_back();
+         }
+         m_maxQueue.emplace_back(index, value);
+         while (m_maxQueue.front().first < oldest) {
+            m_maxQueue.pop_front();
+         }
+         publish();
+      }
+
+      void clear() {
+         m_next = 0;
+         m_count = 0;
+         m_added = 0;
+         m_sum = 0.0;
+         m_sumOfSquares = 0.0;
+         m_minQueue.clear();
+         m_maxQueue.clear();
+         publish();
+      }
+
+      // a consistent view of the window, safe from any thread
+      Snapshot Stats() const {
+         Snapshot snapshot;
+         while (true) {
+            auto before = m_seq.load(std::memory_order_acquire);
+            if ((before & 1) == 0) {
+               snapshot.count = m_published.count.load(std::memory_order_relaxed);
+               snapshot.sum = m_published.sum.load(std::memory_order_relaxed);
+               snapshot.sumOfSquares = m_published.sumOfSquares.load(std::memory_order_relaxed);
+               snapshot.min = m_published.min.load(std::memory_order_relaxed);
+               snapshot.max = m_published.max.load(std::memory_order_relaxed);
+               std::atomic_thread_fence(std::memory_order_acquire);
+               if (m_seq.load(std::memory_order_relaxed) == before) {
+                  return snapshot;
+               }
+            }
+            std::this_thread::yield();
+         }
+      }
+
+      double Mean() const {
+         return Stats().Mean();
+      }
+
+      double Variance() const {
+         return Stats().Variance();
+      }
+
+      uint32_t Count() const {
+         return Stats().count;
+      }
+
+      uint32_t Capacity() const {
+         return m_capacity;
+      }
+
+    private:
+      struct Published {
+         std::atomic<uint32_t> count;
+         std::atomic<double> sum;
+         std::atomic<double> sumOfSquares;
+         std::atomic<T> min;
+         std::atomic<T> max;
+      };
+
+      void recomputeSums() {
+         m_sum = 0.0;
+         m_sumOfSquares = 0.0;
+         for (uint32_t i = 0; i < m_count; i++) {
+            m_sum += double(m_values[i]);
+            m_sumOfSquares += double(m_values[i]) * double(m_values[i]);
+         }
+      }
+
+      void publish() {
+         auto seq = m_seq.load(std::memory_order_relaxed);
+         m_seq.store(seq + 1, std::memory_order_relaxed);
+         std::atomic_thread_fence(std::memory_order_release);
+         m_published.count.store(m_count, std::memory_order_relaxed);
+         m_published.sum.store(m_sum, std::memory_order_relaxed);
+         m_published.sumOfSquares.store(m_sumOfSquares, std::memory_order_relaxed);
+         m_published.min.store(m_minQueue.empty() ? T{} : m_minQueue.front().second,
+                               std::memory_order_relaxed);
+         m_published.max.store(m_maxQueue.empty() ? T{} : m_maxQueue.front().second,
+                               std::memory_order_relaxed);
+         m_seq.store(seq + 2, std::memory_order_release);
+      }
+
+      uint32_t m_capacity;
+      uint32_t m_next;
+      uint32_t m_count;
+      uint64_t m_added;
+      double m_sum;
+      double m_sumOfSquares;
+      std::vector<T> m_values;
+      // (index, value) pairs, the front is the min/max of the window
+      std::deque<std::pair<uint64_t, T>> m_minQueue;
+      std::deque<std::pair<uint64_t, T>> m_maxQueue;
+      std::atomic<uint32_t> m_seq;
+      Published m_published;
+   };
+
+}  // namespace common
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include "config.hpp"
+
+namespace common {
+   // Event rate over the last window time units, updated on every event.
+   // Each event is pushed once and popped once when it falls out of the window, so an update is
+   // O(1) amortized no matter how long the window is.
+   // Add() and Reset() belong to one writer thread, Rate() can be called from any thread.
+   class SlidingWindowRate {
+    public:
+      explicit SlidingWindowRate(int64_t window)
+          : m_window(window > 0 ? window : 1)
+          , m_rate(0.0) {}
+
+      // time must not go backwards, Reset() first on a discontinuity
+      void Add(int64_t time) {
+         m_times.push_back(time);
+         while (time - m_times.front() > m_window) {
+            m_times.pop_front();
+         }
+         double rate = 0.0;
+         auto span = time - m_times.front();
+         if (span > 0) {
+            // n events in the window are n - 1 intervals
+            rate = double(m_times.size() - 1) / double(span);
+         }
+         m_rate.store(rate, std::memory_order_relaxed);
+      }
+
+      void Reset() {
+         m_times.clear();
+         m_rate.store(0.0, std::memory_order_relaxed);
+      }
+
+      // events per time unit, multiply by the units in a second to get a per second rate
+      double Rate() const {
+         return m_rate.load(std::memory_order_relaxed);
+      }
+
+      int64_t Window() const {
+         return m_window;
+      }
+
+    private:
+      int64_t m_window;
+      std::deque<int64_t> m_times;
+      std::atomic<double> m_rate;
+   };
+
+}  // namespace common
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "config.hpp"
+
+namespace common {
+   // Fixed size queue for exactly one producer thread and one consumer thread.
+   // It has the same interface as CircularBuffer but never takes a lock: the try_ functions are
+   // wait-free for the consumer and the producer, the producer and consumer indexes live on their
+   // own cache lines and every slot carries a sequence number telling whose turn it is.
+   // The sequence numbers also let the producer drop the oldest item with evict_back() while
+   // the consumer is reading, both sides then race for the slot with a single CAS.
+   // The _wait functions sleep on a condition variable when there is nothing to do, the other
+   // side only takes the mutex to wake them when a waiter has announced itself.
+   template <typename T>
+   class SpscRingBuffer {
+    public:
+      static const size_t CACHE_LINE_SIZE = 64;
+      // how often a _wait function retries before it goes to sleep
+      static const int SPIN_COUNT = 16;
+
+      SpscRingBuffer(uint32_t cap)
+          : m_head(0)
+          , m_tail(0)
+          , m_cachedHead(0)
+          , m_capacity(cap == 0 ? 1 : cap)
+          , m_consumerWaiting(false)
+          , m_producerWaiting(false)
+          , m_wakeups(0) {
+         m_slotCount = 1;
+         while (m_slotCount < m_capacity) {
+            m_slotCount <<= 1;
+         }
+         m_mask = m_slotCount - 1;
+         m_slots.reset(new Slot[m_slotCount]);
+         for (uint32_t i = 0; i < m_slotCount; i++) {
+            m_slots[i].seq.store(i, std::memory_order_relaxed);
+         }
+      }
+
+      ~SpscRingBuffer() {}
+
+      // producer side, returns false and leaves item untouched when the buffer is full
+      bool try_push_front(T& item) {
+         if (!tryPush(item)) {
+            return false;
+         }
+         notifyConsumer();
+         return true;
+      }
+
+      // producer side, waits until the consumer makes room
+      void push_front(T& item) {
+         push_front_wait(item, -1);
+      }
+
+      // producer side, waits up to timeoutMS (forever if negative) for a free slot,
+      // returns false and leaves item untouched on timeout or a wakeup() during the call
+      bool push_front_wait(T& item, int timeoutMS) {
+         auto wakeups = m_wakeups.load(std::memory_order_acquire);
+         for (int i = 0; i < SPIN_COUNT; i++) {
+            if (try_push_front(item)) {
+               return true;
+            }
+            if (timeoutMS == 0) {
+               return false;
+            }
+            std::this_thread::yield();
+         }
+         std::unique_lock<std::mutex> lock(m_waitMutex);
+         m_producerWaiting.store(true, std::memory_order_relaxed);
+         // pairs with the fence in notifyProducer, either we see the new head or it sees us
+         std::atomic_thread_fence(std::memory_order_seq_cst);
+         bool pushed = false;
+         auto ready = [&]() {
+            return m_wakeups.load(std::memory_order_relaxed) != wakeups || (pushed = tryPush(item));
+         };
+         waitFor(m_notFull, lock, timeoutMS, ready);
+         m_producerWaiting.store(false, std::memory_order_relaxed);
+         lock.unlock();
+         if (pushed) {
+            notifyConsumer();
+         }
+         return pushed;
+      }
+
+      // consumer side, returns false when the buffer is empty
+      bool try_pop_back(T& item) {
+         if (!tryPop(item)) {
+            return false;
+         }
+         notifyProducer();
+         return true;
+      }
+
+      // producer side, drops the oldest item to make room, returns false when the consumer
+      // emptied the buffer first
+      bool evict_back(T& item) {
+         return tryPop(item);
+      }
+
+      // consumer side, returns an empty T when the buffer is empty
+      T pop_back() {
+         T obj{};
+         try_pop_back(obj);
+         return obj;
+      }
+
+      // consumer side, waits up to timeoutMS (forever if negative) for an item,
+      // returns false on timeout or a wakeup() during the call
+      bool pop_back_wait(T& item, int timeoutMS) {
+         auto wakeups = m_wakeups.load(std::memory_order_acquire);
+         for (int i = 0; i < SPIN_COUNT; i++) {
+            if (try_pop_back(item)) {
+               return true;
+            }
+            if (timeoutMS == 0) {
+               return false;
+            }
+            std::this_thread::yield();
+         }
+         std::unique_lock<std::mutex> lock(m_waitMutex);
+         m_consumerWaiting.store(true, std::memory_order_relaxed);
+         // pairs with the fence in notifyConsumer, either we see the new tail or it sees us
+         std::atomic_thread_fence(std::memory_order_seq_cst);
+         bool popped = false;
+         auto ready = [&]() {
+            return m_wakeups.load(std::memory_order_relaxed) != wakeups || (popped = tryPop(item));
+         };
+         waitFor(m_notEmpty, lock, timeoutMS, ready);
+         m_consumerWaiting.store(false, std::memory_order_relaxed);
+         lock.unlock();
+         if (popped) {
+            notifyProducer();
+         }
+         return popped;
+      }
+
+      // makes the push_front_wait and pop_back_wait calls in progress return early. Nothing is
+      // remembered for later calls, a caller that must not wait again checks its own stop flag
+      void wakeup() {
+         std::unique_lock<std::mutex> lock(m_waitMutex);
+         m_wakeups.fetch_add(1, std::memory_order_release);
+         m_notEmpty.notify_all();
+         m_notFull.notify_all();
+      }
+
+      // consumer side
+      void clear() {
+         T obj{};
+         bool popped = false;
+         while (tryPop(obj)) {
+            obj = T{};
+            popped = true;
+         }
+         if (popped) {
+            notifyProducer();
+         }
+      }
+
+      bool isEmpty() const {
+         return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+      }
+
+      uint32_t Count() const {
+         auto head = m_head.load(std::memory_order_acquire);
+         auto tail = m_tail.load(std::memory_order_acquire);
+         return tail > head ? uint32_t(tail - head) : 0;
+      }
+
+      uint32_t Capacity() const {
+         return m_capacity;
+      }
+
+    private:
+      bool tryPush(T& item) {
+         auto tail = m_tail.load(std::memory_order_relaxed);
+         if (tail - m_cachedHead >= m_capacity) {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail - m_cachedHead >= m_capacity) {
+               return false;
+            }
+         }
+         Slot& slot = m_slots[tail & m_mask];
+         if (slot.seq.load(std::memory_order_acquire) != tail) {
+            // the reader that claimed this slot last time round has not moved the item out yet
+            return false;
+         }
+         slot.value = std::move(item);
+         slot.seq.store(tail + 1, std::memory_order_release);
+         m_tail.store(tail + 1, std::memory_order_release);
+         return true;
+      }
+
+      // used by the consumer and by evict_back, the CAS on m_head decides who owns the slot
+      bool tryPop(T& item) {
+         auto head = m_head.load(std::memory_order_relaxed);
+         for (;;) {
+            Slot& slot = m_slots[head & m_mask];
+            auto seq = slot.seq.load(std::memory_order_acquire);
+            auto diff = int64_t(seq) - int64_t(head + 1);
+            if (diff < 0) {
+               return false;
+            }
+            if (diff > 0) {
+               // someone else took this item already
+               head = m_head.load(std::memory_order_relaxed);
+               continue;
+            }
+            if (m_head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+               item = std::move(slot.value);
+               slot.value = T{};
+               slot.seq.store(head + m_slotCount, std::memory_order_release);
+               return true;
+            }
+         }
+      }
+
+      template <typename Predicate>
+      static void waitFor(std::condition_variable& cond, std::unique_lock<std::mutex>& lock,
+                          int timeoutMS, Predicate ready) {
+         if (timeoutMS < 0) {
+            cond.wait(lock, ready);
+         } else {
+            cond.wait_for(lock, std::chrono::milliseconds(timeoutMS), ready);
+         }
+      }
+
+      void notifyConsumer() {
+         std::atomic_thread_fence(std::memory_order_seq_cst);
+         if (m_consumerWaiting.load(std::memory_order_relaxed)) {
+            std::unique_lock<std::mutex> lock(m_waitMutex);
+            m_notEmpty.notify_one();
+         }
+      }
+
+      void notifyProducer() {
+         std::atomic_thread_fence(std::memory_order_seq_cst);
+         if (m_producerWaiting.load(std::memory_order_relaxed)) {
+            std::unique_lock<std::mutex> lock(m_waitMutex);
+            m_notFull.notify_one();
+         }
+      }
+
+      SpscRingBuffer(const SpscRingBuffer&) = delete;
+      SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+      struct Slot {
+         std::atomic<uint64_t> seq;
+         T value;
+      };
+
+      // written by the consumer (and evict_back)
+      alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> m_head;
+
+      // written by the producer
+      alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> m_tail;
+      uint64_t m_cachedHead;
+
+      // read-only after construction
+      alignas(CACHE_LINE_SIZE) uint32_t m_capacity;
+      uint32_t m_slotCount;
+      uint64_t m_mask;
+      std::unique_ptr<Slot[]> m_slots;
+
+      // only used when one side has to sleep
+      alignas(CACHE_LINE_SIZE) std::atomic<bool> m_consumerWaiting;
+      std::atomic<bool> m_producerWaiting;
+      // bumped by every wakeup(), a waiter returns once it differs from what it saw on entry
+      std::atomic<uint64_t> m_wakeups;
+      std::mutex m_waitMutex;
+      std::condition_variable m_notEmpty;
+      std::condition_variable m_notFull;
+   };
+
+}  // namespace common
@@ -62,10 +62,9 @@ namespace common { namespace async {
    }
 
    void Thread::join() {
-      // assert(this->tid() != Thread::currentID());
-      if (!isRunning())
-         return;
-      if (m_handle != nullptr && m_handle->joinable())
+      // a thread that has not set running yet or has just finished must be joined too,
+      // so this goes by the handle rather than the flags
+      if (m_handle != nullptr && m_handle->joinable() && m_handle->get_id() != currentID())
          m_handle->join();
       // assert(!this->running());
    }
@@ -0,0 +1,211 @@
+#include "work-stealing-executor.hpp"
+#include <algorithm>
+#include <exception>
+#ifdef _LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace common { namespace async {
+
+   thread_local WorkStealingExecutor* WorkStealingExecutor::s_currentExecutor = nullptr;
+   thread_local size_t WorkStealingExecutor::s_currentWorker = 0;
+
+   WorkStealingExecutor::WorkStealingExecutor(size_t workers, bool pinToCores)
+      : m_nextWorker(0)
+      , m_queuedTasks(0)
+      , m_sleepingWorkers(0)
+      , m_stopping(false)
+      , m_pinToCores(pinToCores)
+      , m_timerSeq(0)
+      , m_nextDue(Clock::time_point::max().time_since_epoch().count()) {
+      if (workers == 0) {
+         workers = std::max(1u, std::thread::hardware_concurrency());
+      }
+      // every deque exists before the first worker can try to steal from it
+      for (size_t i = 0; i < workers; i++) {
+         m_workers.emplace_back(new Worker());
+      }
+      for (size_t i = 0; i < workers; i++) {
+         m_workers[i]->thread = std::thread([this, i]() { workerLoop(i); });
+      }
+   }
+
+   WorkStealingExecutor::~WorkStealingExecutor() {
+      Stop();
+   }
+
+   void WorkStealingExecutor::Post(Task task) {
+      if (m_stopping) {
+         return;
+      }
+      size_t index;
+      if (s_currentExecutor == this) {
+         index = s_currentWorker;
+      } else {
+         index = m_nextWorker.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+      }
+      push(index, std::move(task));
+   }
+
+   void WorkStealingExecutor::PostAfter(int delayMS, Task task) {
+      if (delayMS <= 0) {
+         Post(std::move(task));
+         return;
+      }
+      {
+         std::unique_lock<std::mutex> lock(m_sleepMtx);
+         if (m_stopping) {
+            return;
+         }
+         m_timers.push_back(Timer{Clock::now() + std::chrono::milliseconds(delayMS), m_timerSeq++,
+                                  std::move(task)});
+         std::push_heap(m_timers.begin(), m_timers.end(), TimerIsLater());
+         updateNextDue();
+      }
+      // a sleeping worker may be waiting for a later deadline
+      m_wakeup.notify_one();
+   }
+
+   void WorkStealingExecutor::Stop() {
+      {
+         std::unique_lock<std::mutex> lock(m_sleepMtx);
+         m_stopping = true;
+      }
+      m_wakeup.notify_all();
+      for (auto& worker : m_workers) {
+         if (worker->thread.joinable() && worker->thread.get_id() != std::this_thread::get_id()) {
+            worker->thread.join();
+         }
+      }
+      for (auto& worker : m_workers) {
+         std::unique_lock<std::mutex> lock(worker->mtx);
+         worker->tasks.clear();
+      }
+      std::unique_lock<std::mutex> lock(m_sleepMtx);
+      m_timers.clear();
+      updateNextDue();
+   }
+
+   void WorkStealingExecutor::push(size_t index, Task task) {
+      {
+         auto& worker = *m_workers[index];
+         std::unique_lock<std::mutex> lock(worker.mtx);
+         worker.tasks.push_back(std::move(task));
+      }
+      // pairs with the sleeping side which counts itself first and checks the queue after,
+      // one of the two always sees the other
+      m_queuedTasks.fetch_add(1, std::memory_order_seq_cst);
+      if (m_sleepingWorkers.load(std::memory_order_seq_cst) > 0) {
+         std::unique_lock<std::mutex> lock(m_sleepMtx);
+         m_wakeup.notify_one();
+      }
+   }
+
+   bool WorkStealingExecutor::popLocal(size_t index, Task& task) {
+      auto& worker = *m_workers[index];
+      std::unique_lock<std::mutex> lock(worker.mtx);
+      if (worker.tasks.empty()) {
+         return false;
+      }
+      // oldest first, a reposted continuation waits behind the tasks queued before it
+      task = std::move(worker.tasks.front());
+      worker.tasks.pop_front();
+      return true;
+   }
+
+   bool WorkStealingExecutor::steal(size_t thief, Task& task) {
+      auto count = m_workers.size();
+      for (size_t i = 1; i < count; i++) {
+         auto& victim = *m_workers[(thief + i) % count];
+         std::unique_lock<std::mutex> lock(victim.mtx, std::try_to_lock);
+         if (!lock.owns_lock() || victim.tasks.empty()) {
+            continue;
+         }
+         // oldest first, the owner is least likely to touch it soon
+         task = std::move(victim.tasks.front());
+         victim.tasks.pop_front();
+         return true;
+      }
+      return false;
+   }
+
+   bool WorkStealingExecutor::takeDueTimers(size_t index) {
+      auto now = Clock::now();
+      bool tookAny = false;
+      while (!m_timers.empty() && m_timers.front().due <= now) {
+         std::pop_heap(m_timers.begin(), m_timers.end(), TimerIsLater());
+         auto task = std::move(m_timers.back().task);
+         m_timers.pop_back();
+         {
+            auto& worker = *m_workers[index];
+            std::unique_lock<std::mutex> lock(worker.mtx);
+            worker.tasks.push_back(std::move(task));
+         }
+         m_queuedTasks.fetch_add(1, std::memory_order_seq_cst);
+         tookAny = true;
+      }
+      if (tookAny) {
+         updateNextDue();
+      }
+      return tookAny;
+   }
+
+   void WorkStealingExecutor::updateNextDue() {
+      auto due = m_timers.empty() ? Clock::time_point::max() : m_timers.front().due;
+      m_nextDue.store(due.time_since_epoch().count(), std::memory_order_relaxed);
+   }
+
+   void WorkStealingExecutor::workerLoop(size_t index) {
+      s_currentExecutor = this;
+      s_currentWorker = index;
+      if (m_pinToCores) {
+         pinCurrentThread(index);
+      }
+      while (!m_stopping) {
+         if (Clock::now().time_since_epoch().count() >= m_nextDue.load(std::memory_order_relaxed)) {
+            std::unique_lock<std::mutex> lock(m_sleepMtx);
+            takeDueTimers(index);
+         }
+         Task task;
+         if (popLocal(index, task) || steal(index, task)) {
+            m_queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+            try {
+               task();
+            } catch (std::exception&) {
+               // a failing task must not take the worker down with it
+            }
+            continue;
+         }
+
+         std::unique_lock<std::mutex> lock(m_sleepMtx);
+         if (takeDueTimers(index) || m_stopping) {
+            continue;
+         }
+         m_sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+         // a steal attempt can miss a deque that was locked at the time, so the counter decides
+         if (m_queuedTasks.load(std::memory_order_seq_cst) == 0) {
+            if (m_timers.empty()) {
+               m_wakeup.wait(lock);
+            } else {
+               m_wakeup.wait_until(lock, m_timers.front().due);
+            }
+         }
+         m_sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+      }
+      s_currentExecutor = nullptr;
+   }
+
+   void WorkStealingExecutor::pinCurrentThread(size_t index) {
+#ifdef _LINUX
+      auto cores = std::max(1u, std::thread::hardware_concurrency());
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(index % cores, &cpus);
+      pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#else
+      (void)index;
+#endif
+   }
+
+}}  // namespace common::async
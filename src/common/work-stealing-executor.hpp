@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "config.hpp"
+#include "executor.hpp"
+
+namespace common { namespace async {
+
+   // Executor with a task deque per worker.
+   // A task posted from a worker goes to that worker's own deque, so a chain of continuations
+   // stays on one core with warm caches. Each worker runs its deque oldest first: a task that
+   // keeps reposting itself goes to the back and can not starve the others queued behind it.
+   // A worker that runs dry steals the oldest task of another one. Tasks posted from outside are
+   // spread over the workers round robin. Each deque has its own small mutex, so workers only
+   // contend with a thief, never with each other as a whole.
+   // Due timers are checked before every task, not only when a worker is idle, so PostAfter
+   // keeps its deadline while all workers are busy.
+   // Workers can be pinned to one core each, which keeps the continuations of a stream on the
+   // same core for good (Linux only, ignored elsewhere).
+   class WorkStealingExecutor : public Executor {
+    public:
+      // 0 starts one worker per core
+      explicit WorkStealingExecutor(size_t workers = 0, bool pinToCores = false);
+      ~WorkStealingExecutor();
+
+      void Post(Task task) override;
+      void PostAfter(int delayMS, Task task) override;
+
+      size_t WorkerCount() const override {
+         return m_workers.size();
+      }
+
+      // waits for the running tasks and joins the workers, queued tasks are dropped
+      void Stop();
+
+    private:
+      typedef std::chrono::steady_clock Clock;
+
+      struct alignas(64) Worker {
+         std::mutex mtx;
+         std::deque<Task> tasks;
+         std::thread thread;
+      };
+
+      struct Timer {
+         Clock::time_point due;
+         uint64_t seq;
+         Task task;
+      };
+
+      struct TimerIsLater {
+         bool operator()(const Timer& a, const Timer& b) const {
+            return a.due > b.due || (a.due == b.due && a.seq > b.seq);
+         }
+      };
+
+      void workerLoop(size_t index);
+      void push(size_t index, Task task);
+      bool popLocal(size_t index, Task& task);
+      bool steal(size_t thief, Task& task);
+      // moves due timers to the worker's deque, m_sleepMtx must be held
+      bool takeDueTimers(size_t index);
+      // m_sleepMtx must be held
+      void updateNextDue();
+      void pinCurrentThread(size_t index);
+
+      WorkStealingExecutor(const WorkStealingExecutor&) = delete;
+      WorkStealingExecutor& operator=(const WorkStealingExecutor&) = delete;
+
+      std::vector<std::unique_ptr<Worker>> m_workers;
+      std::atomic<size_t> m_nextWorker;
+      // tasks sitting in the deques, a worker only sleeps when it reads zero
+      std::atomic<int64_t> m_queuedTasks;
+      std::atomic<int> m_sleepingWorkers;
+      std::atomic<bool> m_stopping;
+      bool m_pinToCores;
+
+      // guards the timers and the sleeping workers
+      std::mutex m_sleepMtx;
+      std::condition_variable m_wakeup;
+      std::vector<Timer> m_timers;
+      uint64_t m_timerSeq;
+      // due time of the first timer in Clock ticks, lets a busy worker skip m_sleepMtx
+      std::atomic<Clock::rep> m_nextDue;
+
+      // the executor and worker the current thread belongs to, if any
+      static thread_local WorkStealingExecutor* s_currentExecutor;
+      static thread_local size_t s_currentWorker;
+   };
+
+}}  // namespace common::async
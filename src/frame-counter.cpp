@@ -4,15 +4,23 @@
 
 namespace challenge { namespace media {
    
-   FrameCounter::FrameCounter(int duration)
-      : PacketSourceSubscriber(50)
-      , m_durations(15)
+   FrameCounter::FrameCounter(int duration, CountingMode mode, OverflowPolicy policy,
+                              DecoderOptions decoderOptions)
+      : PacketSourceSubscriber(50, policy)
+      , m_mode(mode)
+      , m_durations(60)
+      , m_packetSizes(60)
       , m_targetDuration(duration)
-      , m_fps(0.0)
-      , m_frameCounts(-1)
+      , m_rate(int64_t(duration) * 1000)
+      , m_frameCounts(0)
+      , m_reportedDrops(0)
+      , m_decoderOptions(decoderOptions)
+      , m_hasLastFrame(false)
       , m_lastFrameTime(0)
-      , m_currentDuration(0)
-      , m_isStarted(false) {}
+      , m_lastReportTime(0)
+      , m_isStarted(false)
+      , m_needToStop(false)
+      , m_seenKeyFrame(false) {}
 
    FrameCounter::~FrameCounter() {}
 
@@ -21,26 +29,41 @@ namespace challenge { namespace media {
       if (videoStream == nullptr) {
          return false;
       }
+      RequestMediaType(AVMEDIA_TYPE_VIDEO);
       m_streamBaseTime = videoStream->time_base;
       spdlog::info("setupping frame counter");
+      if (m_mode == CountingMode::Packets) {
+         // frames are counted from packet timestamps, no decoder needed.
+         // video_delay is the stream's reorder depth when the demuxer knows it, the window
+         // grows on its own when it does not
+         m_reorderWindow.Reset(videoStream->codecpar->video_delay);
+         return true;
+      }
       return m_decoder.Open([this](int width, int height, FramePtr frame) { this->frameCallback(frame); },
-                     videoStream->codecpar, m_streamBaseTime);
+                     videoStream->codecpar, m_streamBaseTime, m_decoderOptions);
    }
 
    void FrameCounter::Start() {
       if (m_isStarted) {
          return;
       }
-      if (!m_decoder.IsInitiated()) {
+      if (m_mode == CountingMode::Decode && !m_decoder.IsInitiated()) {
          spdlog::info("initializing the decoder failed");
          return;
       }
       m_needToStop = false;
+      m_seenKeyFrame = false;
+      m_hasLastFrame = false;
+      m_rate.Reset();
+      m_durations.clear();
+      m_packetSizes.clear();
+      m_reorderWindow.Reset(m_reorderWindow.Depth());
       m_readThrd.start([&]() { readLoop(); });
    }
 
    void FrameCounter::Stop() {
       m_needToStop = true;
+      WakeReader();
       m_readThrd.join();
       m_decoder.Close();
       m_isStarted = false;
@@ -50,35 +73,127 @@ namespace challenge { namespace media {
       m_isStarted = true;
       spdlog::info("fps counter started");
       while (!m_needToStop) {
-         auto pkt = ReadPacket();
+         auto pkt = ReadPacket(READ_TIMEOUT_MS);
          if (!pkt) {
-            common::async::sleep(10);
             continue;
          }
-         // spdlog::info("pkt pts is {}", pkt->PTS());
-         m_decoder.Decode(pkt);
+         handlePacket(pkt);
       }
       m_isStarted = false;
-      m_needToStop = false;
+   }
+
+   int FrameCounter::ProcessPackets(int maxPackets) {
+      int handled = 0;
+      while (handled < maxPackets) {
+         auto pkt = ReadPacket();
+         if (!pkt) {
+            break;
+         }
+         handlePacket(pkt);
+         handled++;
+      }
+      return handled;
+   }
+
+   void FrameCounter::handlePacket(Packet::Ptr& pkt) {
+      if (pkt->HasFlag(PacketFlags::VideoPacket)) {
+         m_packetSizes.Add(pkt->Size());
+      }
+      if (m_mode == CountingMode::Packets) {
+         packetCallback(pkt);
+      } else {
+         m_decoder.Decode(pkt);
+      }
    }
 
    void FrameCounter::frameCallback(FramePtr frame) {
+      countFrame(frame->PTS());
+   }
+
+   void FrameCounter::packetCallback(const Packet::Ptr& pkt) {
+      if (!pkt->HasFlag(PacketFlags::VideoPacket)) {
+         return;
+      }
+      // the decoder can not output anything before the first keyframe,
+      // so skip leading packets to report the same numbers as the decode path
+      if (!m_seenKeyFrame) {
+         if (!pkt->IsKey()) {
+            return;
+         }
+         m_seenKeyFrame = true;
+      }
+      auto pts = pkt->PTS() != AV_NOPTS_VALUE ? pkt->PTS() : pkt->DTS();
+      if (pts == AV_NOPTS_VALUE) {
+         return;
+      }
+      if (m_reorderWindow.Discontinuity(pts)) {
+         // count what was pending before the jump, countFrame then sees the step back
+         int64_t pending;
+         while (m_reorderWindow.Drain(pending)) {
+            countFrame(pending);
+         }
+         m_reorderWindow.Restart();
+      }
+      if (!m_reorderWindow.Push(pts)) {
+         spdlog::warn("packet pts {} arrived too late, reorder window grown to {} frames", pts,
+                      m_reorderWindow.Depth());
+      }
+      while (m_reorderWindow.Pop(pts)) {
+         countFrame(pts);
+      }
+   }
+
+   void FrameCounter::countFrame(int64_t pts) {
       m_frameCounts++;
-      AVRational perSecond = AVRational{1, 1000};
-      auto frameTime = av_rescale_q_rnd(frame->PTS(), m_streamBaseTime, perSecond, AV_ROUND_NEAR_INF);
-      int duration = int(frameTime - m_lastFrameTime);
+      auto frameTime = av_rescale_q(pts, m_streamBaseTime, AVRational{1, 1000000});
+      if (m_hasLastFrame) {
+         if (frameTime > m_lastFrameTime) {
+            m_intervals.Record(uint64_t(frameTime - m_lastFrameTime));
+            m_durations.Add(frameTime - m_lastFrameTime);
+         } else if (frameTime < m_lastFrameTime) {
+            // timestamps jumped back (wrap, loop or a new segment), start the window over
+            m_rate.Reset();
+            m_durations.clear();
+            m_lastReportTime = frameTime;
+         }
+      } else {
+         m_lastReportTime = frameTime;
+      }
+      m_hasLastFrame = true;
       m_lastFrameTime = frameTime;
-      m_currentDuration += duration;
-      // spdlog::info("frame pts is {}", frame->PTS());
-      // spdlog::info("frame duration is {}", duration);
-      if (m_currentDuration>m_targetDuration) {
-         m_fps = m_frameCounts / (m_targetDuration/1000);
-         spdlog::info("frame-rate is {}", m_fps);
-         m_currentDuration = 0;
-         m_frameCounts = 0;
-      }
-      // m_durations.push_front(duration);
-      // m_fps = 1000/(double)m_durations.mean();
-      
+      m_rate.Add(frameTime);
+
+      if (frameTime - m_lastReportTime >= m_rate.Window()) {
+         m_lastReportTime = frameTime;
+         auto jitter = Jitter();
+         auto durations = m_durations.Stats();
+         spdlog::info("frame-rate is {:.2f}, frame interval p50 {:.1f} p95 {:.1f} p99 {:.1f} max {:.1f} ms",
+                      FPS(), jitter.p50, jitter.p95, jitter.p99, jitter.max);
+         spdlog::info("last {} frames: interval {:.1f} +- {:.1f} ms, bitrate {:.0f} kbps", durations.count,
+                      durations.Mean() / 1000.0, durations.StdDev() / 1000.0, Bitrate() / 1000.0);
+         auto backpressure = Backpressure();
+         if (backpressure.dropped != m_reportedDrops) {
+            spdlog::warn("frame counter is falling behind, {} packets dropped so far",
+                         backpressure.dropped);
+            m_reportedDrops = backpressure.dropped;
+         }
+      }
+   }
+
+   double FrameCounter::FPS() const {
+      return m_rate.Rate() * 1000000;
+   }
+
+   double FrameCounter::Bitrate() const {
+      return m_packetSizes.Mean() * 8 * FPS();
+   }
+
+   JitterStats FrameCounter::Jitter() const {
+      JitterStats stats;
+      stats.p50 = m_intervals.Percentile(0.50) / 1000.0;
+      stats.p95 = m_intervals.Percentile(0.95) / 1000.0;
+      stats.p99 = m_intervals.Percentile(0.99) / 1000.0;
+      stats.max = m_intervals.Max() / 1000.0;
+      return stats;
    }
 }}  // namespace challenge::media
\ No newline at end of file
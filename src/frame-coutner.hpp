@@ -2,14 +2,31 @@
 
 #include "packet-source.hpp"
 #include "media/video-decoder.hpp"
-#include "common/circular-buffer.hpp"
+#include "media/pts-reorder-window.hpp"
+#include "common/rolling-stats.hpp"
+#include "common/log-histogram.hpp"
+#include "common/sliding-window-rate.hpp"
 #include "packet-source-subscriber.hpp"
 
 namespace challenge { namespace media {
 
+   // Decode runs every packet through the video decoder and counts decoded pictures,
+   // Packets counts demuxed video packets by their timestamps without decoding anything.
+   enum class CountingMode { Decode, Packets };
+
+   // inter-frame intervals in milliseconds
+   struct JitterStats {
+      double p50;
+      double p95;
+      double p99;
+      double max;
+   };
+
    class FrameCounter : public media::PacketSourceSubscriber {
     public:
-      FrameCounter(int durationMS);
+      FrameCounter(int durationMS, CountingMode mode = CountingMode::Decode,
+                   OverflowPolicy policy = OverflowPolicy::Block,
+                   DecoderOptions decoderOptions = DecoderOptions());
       ~FrameCounter();
 
       virtual std::string ObjectName() override {
@@ -18,23 +35,61 @@ namespace challenge { namespace media {
 
       virtual bool Setup(const AVPacketSource* source) override;
 
+      // Start() runs the counter on its own thread, ProcessPackets() is the same work for a caller
+      // that schedules it itself (StreamManager), never mix them
       void Start();
       void Stop();
 
+      // handles up to maxPackets queued packets without waiting, returns how many it handled
+      int ProcessPackets(int maxPackets);
+
+      CountingMode Mode() const {
+         return m_mode;
+      }
+
+      // both can be read from any thread while the counter is running
+      double FPS() const;
+      JitterStats Jitter() const;
+      // video bits per second, from the average packet size of the last frames and the frame-rate
+      double Bitrate() const;
+
+    protected:
+      bool isStopping() const override {
+         return m_needToStop;
+      }
+
     private:
+      // Stop() wakes the reader anyway, this only bounds how long a missed wakeup can last
+      static const int READ_TIMEOUT_MS = 500;
+
       void readLoop();
+      void handlePacket(Packet::Ptr& pkt);
       void frameCallback(FramePtr frame);
+      void packetCallback(const Packet::Ptr& pkt);
+      void countFrame(int64_t pts);
 
+      CountingMode m_mode;
       bool m_isStarted;
-      bool m_needToStop;
+      // read by the source's thread through isStopping() while Stop() sets it
+      std::atomic<bool> m_needToStop;
+      bool m_seenKeyFrame;
+      bool m_hasLastFrame;
+      // stream time in microseconds
       int64_t m_lastFrameTime;
+      int64_t m_lastReportTime;
       int64_t m_frameCounts;
-      int m_currentDuration;
+      uint64_t m_reportedDrops;
       int m_targetDuration;
-      double m_fps;
+      common::SlidingWindowRate m_rate;
+      common::LogHistogram m_intervals;
+      // packets arrive in decode order, the decoder path gets its frames sorted already
+      PtsReorderWindow m_reorderWindow;
       VideoDecoder m_decoder;
+      DecoderOptions m_decoderOptions;
       AVRational m_streamBaseTime;
-      common::CircularBuffer<int> m_durations;
+      // last frame intervals in microseconds and the last packet sizes in bytes
+      common::RollingStats<int64_t> m_durations;
+      common::RollingStats<int64_t> m_packetSizes;
       common::async::Thread m_readThrd;
    };
 
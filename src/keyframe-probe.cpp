@@ -0,0 +1,91 @@
+#include "keyframe-probe.hpp"
+#include <spdlog/spdlog.h>
+
+namespace challenge { namespace media {
+
+   KeyFrameProbe::KeyFrameProbe(int intervalMS, DecoderOptions decoderOptions)
+      : PacketSourceSubscriber(4, OverflowPolicy::DropOldest)
+      , m_isStarted(false)
+      , m_needToStop(false)
+      , m_intervalMS(intervalMS)
+      , m_lastProbeTime(AV_NOPTS_VALUE)
+      , m_probedFrames(0)
+      , m_decoderOptions(decoderOptions)
+      , m_streamBaseTime(AVRational{1, 1000}) {}
+
+   KeyFrameProbe::~KeyFrameProbe() {}
+
+   bool KeyFrameProbe::Setup(const AVPacketSource* source) {
+      auto videoStream = source->VideoStream();
+      if (videoStream == nullptr) {
+         return false;
+      }
+      RequestMediaType(AVMEDIA_TYPE_VIDEO);
+      m_streamBaseTime = videoStream->time_base;
+      spdlog::info("setupping keyframe probe");
+      return m_decoder.Open([this](int, int, FramePtr frame) { this->frameCallback(frame); },
+                            videoStream->codecpar, m_streamBaseTime, m_decoderOptions);
+   }
+
+   void KeyFrameProbe::NewPacket(Packet::Ptr pkt) {
+      if (!pkt || !pkt->HasFlag(PacketFlags::VideoPacket) || !pkt->IsKey()) {
+         return;
+      }
+      auto pts = pkt->PTS() != AV_NOPTS_VALUE ? pkt->PTS() : pkt->DTS();
+      if (m_intervalMS > 0 && pts != AV_NOPTS_VALUE) {
+         auto time = av_rescale_q(pts, m_streamBaseTime, AVRational{1, 1000});
+         // a jump backwards (loop, reconnect) starts a new interval
+         if (m_lastProbeTime != AV_NOPTS_VALUE && time >= m_lastProbeTime &&
+             time - m_lastProbeTime < m_intervalMS) {
+            return;
+         }
+         m_lastProbeTime = time;
+      }
+      PacketSourceSubscriber::NewPacket(std::move(pkt));
+   }
+
+   void KeyFrameProbe::Start() {
+      if (m_isStarted) {
+         return;
+      }
+      if (!m_decoder.IsInitiated()) {
+         spdlog::info("initializing the decoder failed");
+         return;
+      }
+      m_needToStop = false;
+      m_readThrd.start([&]() { readLoop(); });
+   }
+
+   void KeyFrameProbe::Stop() {
+      m_needToStop = true;
+      WakeReader();
+      m_readThrd.join();
+      m_decoder.Close();
+      m_isStarted = false;
+   }
+
+   void KeyFrameProbe::readLoop() {
+      m_isStarted = true;
+      spdlog::info("keyframe probe started");
+      while (!m_needToStop) {
+         auto pkt = ReadPacket(READ_TIMEOUT_MS);
+         if (!pkt) {
+            continue;
+         }
+         m_decoder.Decode(pkt);
+         // drain the picture right away and forget the keyframe, the next packet we get
+         // is another keyframe anyway
+         m_decoder.Flush();
+      }
+      m_isStarted = false;
+   }
+
+   void KeyFrameProbe::frameCallback(FramePtr frame) {
+      m_probedFrames++;
+      spdlog::info("stream is healthy, decoded keyframe {}x{} at pts {}", frame->ImageWidth(),
+                   frame->ImageHeight(), frame->PTS());
+      if (m_probeCallback) {
+         m_probeCallback(frame);
+      }
+   }
+}}  // namespace challenge::media
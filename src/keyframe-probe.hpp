@@ -0,0 +1,67 @@
+#pragma once
+
+#include "packet-source.hpp"
+#include "media/video-decoder.hpp"
+#include "packet-source-subscriber.hpp"
+#include <atomic>
+#include <functional>
+
+namespace challenge { namespace media {
+
+   // Decodes only keyframes, at most one per interval, to prove a stream is healthy with a real
+   // picture at a tiny fraction of the cost of decoding everything.
+   // Every other packet is dropped before it even reaches the queue and the decoder is flushed
+   // after each probe, so it never waits for references that will not come.
+   class KeyFrameProbe : public media::PacketSourceSubscriber {
+    public:
+      typedef std::function<void(FramePtr frame)> ProbeCallback;
+
+      // intervalMS 0 probes every keyframe
+      KeyFrameProbe(int intervalMS, DecoderOptions decoderOptions = DecoderOptions::LowLatency());
+      ~KeyFrameProbe();
+
+      virtual std::string ObjectName() override {
+         return "KeyFrameProbe";
+      }
+
+      virtual bool Setup(const AVPacketSource* source) override;
+
+      virtual void NewPacket(Packet::Ptr pkt) override;
+
+      // called on the probe's thread for every decoded keyframe, set it before Start()
+      void OnProbe(ProbeCallback callback) {
+         m_probeCallback = callback;
+      }
+
+      void Start();
+      void Stop();
+
+      int64_t ProbedFrames() const {
+         return m_probedFrames;
+      }
+
+    protected:
+      bool isStopping() const override {
+         return m_needToStop;
+      }
+
+    private:
+      static const int READ_TIMEOUT_MS = 500;
+
+      void readLoop();
+      void frameCallback(FramePtr frame);
+
+      bool m_isStarted;
+      std::atomic<bool> m_needToStop;
+      int m_intervalMS;
+      // last forwarded keyframe in ms, only touched by the source thread
+      int64_t m_lastProbeTime;
+      std::atomic<int64_t> m_probedFrames;
+      VideoDecoder m_decoder;
+      DecoderOptions m_decoderOptions;
+      AVRational m_streamBaseTime;
+      ProbeCallback m_probeCallback;
+      common::async::Thread m_readThrd;
+   };
+
+}}  // namespace challenge::media
@@ -2,6 +2,9 @@
 #include "spdlog/sinks/basic_file_sink.h"
 #include "fmt/fmt.hpp"
 #include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
 
 #include "media/ffmpeg.h"
 
@@ -16,6 +19,10 @@ extern "C" {
 
 #include "packet-source.hpp"
 #include "frame-coutner.hpp"
+#include "keyframe-probe.hpp"
+#include "audio-rate-counter.hpp"
+#include "stream-manager.hpp"
+#include "common/work-stealing-executor.hpp"
 
 int main(int argc, char* argv[]) {
    if (argc<2) {
@@ -28,14 +35,139 @@ int main(int argc, char* argv[]) {
    spdlog::set_pattern("[%H:%M:%S %z] [%n] [%^---%L---%$] [thread %t] %v");
 
    challenge::media::FFmpegInitializer::Init();
-   std::string url = argv[1];
+   std::vector<std::string> urls;
+   auto mode = challenge::media::CountingMode::Decode;
+   auto policy = challenge::media::OverflowPolicy::Block;
+   auto decoderOptions = challenge::media::DecoderOptions::LowLatency();
+   int decoderThreads = -1;
+   bool lightDecoding = false;
+   int probeIntervalMS = -1;
+   bool countAudio = false;
+   int workers = -1;
+   int ioThreads = 0;
+   challenge::media::SourceOptions sourceOptions;
+   bool pinWorkers = false;
+   for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg == "--packets") {
+         mode = challenge::media::CountingMode::Packets;
+      } else if (arg == "--throughput") {
+         decoderOptions = challenge::media::DecoderOptions::Throughput();
+      } else if (arg == "--audio") {
+         countAudio = true;
+      } else if (arg == "--light") {
+         lightDecoding = true;
+      } else if (arg.compare(0, 10, "--threads=") == 0) {
+         decoderThreads = std::atoi(arg.c_str() + 10);
+      } else if (arg.compare(0, 10, "--workers=") == 0) {
+         workers = std::atoi(arg.c_str() + 10);
+      } else if (arg.compare(0, 13, "--io-threads=") == 0) {
+         ioThreads = std::atoi(arg.c_str() + 13);
+      } else if (arg == "--fast-start") {
+         auto fastStart = challenge::media::SourceOptions::FastStart();
+         sourceOptions.probeSize = fastStart.probeSize;
+         sourceOptions.analyzeDurationUS = fastStart.analyzeDurationUS;
+         sourceOptions.fpsProbeSize = fastStart.fpsProbeSize;
+      } else if (arg.compare(0, 12, "--probesize=") == 0) {
+         sourceOptions.probeSize = std::atoll(arg.c_str() + 12);
+      } else if (arg.compare(0, 18, "--analyzeduration=") == 0) {
+         sourceOptions.analyzeDurationUS = std::atoll(arg.c_str() + 18) * 1000;
+      } else if (arg.compare(0, 15, "--stream-cache=") == 0) {
+         sourceOptions.streamInfoCacheDir = arg.substr(15);
+      } else if (arg == "--io=default") {
+         sourceOptions.ioBackend = challenge::media::IOBackend::Default;
+      } else if (arg == "--io=pread") {
+         sourceOptions.ioBackend = challenge::media::IOBackend::Pread;
+      } else if (arg == "--io=mmap") {
+         sourceOptions.ioBackend = challenge::media::IOBackend::Mmap;
+      } else if (arg == "--io=uring") {
+         sourceOptions.ioBackend = challenge::media::IOBackend::IoUring;
+      } else if (arg.compare(0, 12, "--io-buffer=") == 0) {
+         sourceOptions.ioBufferSize = std::atoi(arg.c_str() + 12) * 1024;
+      } else if (arg == "--pin") {
+         pinWorkers = true;
+      } else if (arg.compare(0, 8, "--probe=") == 0) {
+         probeIntervalMS = std::atoi(arg.c_str() + 8) * 1000;
+      } else if (arg == "--overflow=block") {
+         policy = challenge::media::OverflowPolicy::Block;
+      } else if (arg == "--overflow=drop-oldest") {
+         policy = challenge::media::OverflowPolicy::DropOldest;
+      } else if (arg == "--overflow=drop-until-key") {
+         policy = challenge::media::OverflowPolicy::DropUntilKeyFrame;
+      } else if (arg == "--overflow=block-timeout") {
+         policy = challenge::media::OverflowPolicy::BlockWithTimeout;
+      } else {
+         urls.push_back(arg);
+      }
+   }
+   if (urls.empty()) {
+      spdlog::info("no media url provided");
+      return 0;
+   }
+   // --throughput replaces all decoder options, so --light goes on top whatever the order
+   decoderOptions.light = decoderOptions.light || lightDecoding;
+   if (urls.size() > 1 || workers >= 0) {
+      if (countAudio) {
+         spdlog::error("--audio only works with a single input");
+         return 1;
+      }
+      // the pool already keeps every core busy, a decoder thread per core per stream would
+      // only oversubscribe them
+      decoderOptions.threadCount = decoderThreads >= 0 ? decoderThreads : 1;
+      auto executor = std::make_shared<common::async::WorkStealingExecutor>(
+          size_t(std::max(workers, 0)), pinWorkers);
+      // opening and reading may block in libav, they get threads of their own so a stalled
+      // input never holds a counting worker. One per input up to a cap by default
+      if (ioThreads <= 0) {
+         ioThreads = int(std::min(urls.size(), size_t(challenge::media::StreamManager::MAX_IO_THREADS)));
+      }
+      auto ioExecutor = std::make_shared<common::async::WorkStealingExecutor>(size_t(ioThreads));
+      challenge::media::StreamManager manager(executor, ioExecutor, 2000, mode, decoderOptions,
+                                              sourceOptions);
+      for (auto& url : urls) {
+         manager.Add(url);
+      }
+      std::string input;
+      while (input != "quit") {
+         std::cin >> input;
+      }
+      manager.Stop();
+      ioExecutor->Stop();
+      executor->Stop();
+      return 0;
+   }
+   auto url = urls.front();
+   if (decoderThreads >= 0) {
+      decoderOptions.threadCount = decoderThreads;
+   }
    try {
-      auto frameCounter = std::make_shared<challenge::media::FrameCounter>(2000);
-      challenge::media::AVPacketSource pktsource;
+      auto frameCounter = std::make_shared<challenge::media::FrameCounter>(2000, mode, policy,
+                                                                          decoderOptions);
+      std::shared_ptr<challenge::media::KeyFrameProbe> probe;
+      if (probeIntervalMS >= 0) {
+         probe = std::make_shared<challenge::media::KeyFrameProbe>(probeIntervalMS);
+      }
+      std::shared_ptr<challenge::media::AudioRateCounter> audioCounter;
+      if (countAudio) {
+         audioCounter = std::make_shared<challenge::media::AudioRateCounter>(2000, policy);
+      }
+      challenge::media::AVPacketSource pktsource(sourceOptions);
       
       pktsource.Subscribe(frameCounter);
+      if (probe) {
+         pktsource.Subscribe(probe);
+      }
+      if (audioCounter) {
+         pktsource.Subscribe(audioCounter);
+      }
       pktsource.Start(url);
       frameCounter->Start();
+      if (probe) {
+         probe->Start();
+      }
+      if (audioCounter) {
+         audioCounter->Start();
+      }
 
       std::string input;
       while (input != "quit") {
@@ -43,6 +175,14 @@ int main(int argc, char* argv[]) {
       }
       pktsource.Unsubscribe(frameCounter);
       frameCounter->Stop();
+      if (probe) {
+         pktsource.Unsubscribe(probe);
+         probe->Stop();
+      }
+      if (audioCounter) {
+         pktsource.Unsubscribe(audioCounter);
+         audioCounter->Stop();
+      }
       pktsource.Stop();
    } catch (std::exception& ex) {
       spdlog::error(ex.what());
@@ -0,0 +1,213 @@
+#include "file-io.hpp"
+#include "uring-file-io.hpp"
+#include "common/config.hpp"
+#include <spdlog/spdlog.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef PLATFORM_OS_FAMILY_UNIX
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace challenge { namespace media {
+
+#ifdef PLATFORM_OS_FAMILY_UNIX
+   namespace {
+      class PreadFileIO : public FileIO {
+       public:
+         PreadFileIO(int fd, int64_t size) : FileIO(fd, size) {}
+
+       protected:
+         int read(uint8_t* buf, int size) override {
+            while (true) {
+               auto ret = ::pread(m_fd, buf, size_t(size), off_t(m_position));
+               if (ret >= 0) {
+                  return int(ret);
+               }
+               if (errno != EINTR) {
+                  return AVERROR(errno);
+               }
+            }
+         }
+      };
+
+      class MmapFileIO : public FileIO {
+       public:
+         MmapFileIO(int fd, int64_t size)
+            : FileIO(fd, size)
+            , m_map(nullptr) {}
+
+         ~MmapFileIO() {
+            if (m_map != nullptr) {
+               munmap(m_map, size_t(m_size));
+            }
+         }
+
+         bool Map() {
+            if (m_size == 0) {
+               return true;
+            }
+            auto map = mmap(nullptr, size_t(m_size), PROT_READ, MAP_PRIVATE, m_fd, 0);
+            if (map == MAP_FAILED) {
+               return false;
+            }
+            m_map = static_cast<uint8_t*>(map);
+            // demuxing reads front to back, let the kernel read ahead aggressively and drop
+            // pages behind us
+            madvise(m_map, size_t(m_size), MADV_SEQUENTIAL);
+            return true;
+         }
+
+       protected:
+         int read(uint8_t* buf, int size) override {
+            auto left = m_size - m_position;
+            auto count = left < size ? int(left) : size;
+            if (count > 0) {
+               memcpy(buf, m_map + m_position, size_t(count));
+            }
+            return count;
+         }
+
+       private:
+         uint8_t* m_map;
+      };
+   }  // namespace
+#endif
+
+   std::string FileIO::LocalPath(const std::string& uri) {
+      if (uri.compare(0, 5, "file:") == 0) {
+         return uri.substr(5);
+      }
+      if (uri.find("://") != std::string::npos) {
+         return std::string();
+      }
+      return uri;
+   }
+
+   std::unique_ptr<FileIO> FileIO::Open(const std::string& uri, IOBackend backend, int bufferSize) {
+      std::unique_ptr<FileIO> io;
+      auto path = LocalPath(uri);
+      if (backend == IOBackend::Default || path.empty()) {
+         return io;
+      }
+#ifdef PLATFORM_OS_FAMILY_UNIX
+      int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+         spdlog::warn("can not open {} for custom I/O: {}", path, strerror(errno));
+         return io;
+      }
+      struct stat info;
+      if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+         ::close(fd);
+         return io;
+      }
+      if (backend == IOBackend::Mmap) {
+         auto mapped = new MmapFileIO(fd, info.st_size);
+         io.reset(mapped);
+         if (!mapped->Map()) {
+            spdlog::warn("can not map {}, reading it with pread", path);
+            io.reset(new PreadFileIO(dup(fd), info.st_size));
+         }
+      } else if (backend == IOBackend::IoUring) {
+#ifdef CHALLENGE_HAVE_IO_URING
+         io = UringFileIO::Create(fd, info.st_size, bufferSize);
+#endif
+         if (!io) {
+            spdlog::warn("io_uring is not available, reading {} with pread", path);
+            io.reset(new PreadFileIO(fd, info.st_size));
+         }
+      } else {
+         io.reset(new PreadFileIO(fd, info.st_size));
+      }
+      if (!io->createContext(bufferSize)) {
+         io.reset();
+      }
+#else
+      spdlog::warn("custom file I/O is not available on this platform");
+#endif
+      return io;
+   }
+
+   FileIO::FileIO(int fd, int64_t size)
+      : m_fd(fd)
+      , m_size(size)
+      , m_position(0)
+      , m_context(nullptr) {}
+
+   FileIO::~FileIO() {
+      if (m_context != nullptr) {
+         // libavformat may have swapped the buffer for one of its own
+         av_freep(&m_context->buffer);
+         avio_context_free(&m_context);
+      }
+#ifdef PLATFORM_OS_FAMILY_UNIX
+      if (m_fd >= 0) {
+         ::close(m_fd);
+      }
+#endif
+   }
+
+   bool FileIO::createContext(int bufferSize) {
+      if (bufferSize <= 0) {
+         bufferSize = DEFAULT_BUFFER_SIZE;
+      }
+      auto buffer = static_cast<uint8_t*>(av_malloc(size_t(bufferSize)));
+      if (buffer == nullptr) {
+         return false;
+      }
+      m_context = avio_alloc_context(buffer, bufferSize, 0, this, &FileIO::readPacket, nullptr,
+                                     &FileIO::seek);
+      if (m_context == nullptr) {
+         av_free(buffer);
+         return false;
+      }
+      return true;
+   }
+
+   int FileIO::readPacket(void* opaque, uint8_t* buf, int size) {
+      auto io = static_cast<FileIO*>(opaque);
+      if (io->m_position >= io->m_size) {
+         return AVERROR_EOF;
+      }
+      auto ret = io->read(buf, size);
+      if (ret == 0) {
+         return AVERROR_EOF;
+      }
+      if (ret > 0) {
+         io->m_position += ret;
+      }
+      return ret;
+   }
+
+   int64_t FileIO::seek(void* opaque, int64_t offset, int whence) {
+      auto io = static_cast<FileIO*>(opaque);
+      whence &= ~AVSEEK_FORCE;
+      int64_t position;
+      switch (whence) {
+         case AVSEEK_SIZE:
+            return io->m_size;
+         case SEEK_SET:
+            position = offset;
+            break;
+         case SEEK_CUR:
+            position = io->m_position + offset;
+            break;
+         case SEEK_END:
+            position = io->m_size + offset;
+            break;
+         default:
+            return AVERROR(EINVAL);
+      }
+      if (position < 0) {
+         return AVERROR(EINVAL);
+      }
+      io->m_position = position;
+      io->seeked();
+      return position;
+   }
+
+}}  // namespace challenge::media
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include "ffmpeg.h"
+
+namespace challenge { namespace media {
+
+   // How AVPacketSource reads local files.
+   // Default leaves it to libavformat's file protocol and its 32KB buffer, Pread reads the file
+   // through a much larger buffer with one pread per refill and Mmap maps the whole file and
+   // lets the kernel read ahead, no read syscalls at all. IoUring keeps several buffer sized reads
+   // queued ahead of the demuxer (Linux only, falls back to Pread).
+   enum class IOBackend { Default, Pread, Mmap, IoUring };
+
+   // A local file behind a custom AVIOContext, set it as AVFormatContext::pb before
+   // avformat_open_input and destroy it after avformat_close_input.
+   class FileIO {
+    public:
+      static const int DEFAULT_BUFFER_SIZE = 4 * 1024 * 1024;
+
+      // nullptr when the uri is not a local file or the backend is not available here,
+      // the caller then falls back to Default
+      static std::unique_ptr<FileIO> Open(const std::string& uri, IOBackend backend,
+                                          int bufferSize = DEFAULT_BUFFER_SIZE);
+
+      // the path of a local file uri (plain path or file:), empty for anything else
+      static std::string LocalPath(const std::string& uri);
+
+      virtual ~FileIO();
+
+      AVIOContext* Context() const {
+         return m_context;
+      }
+
+    protected:
+      FileIO(int fd, int64_t size);
+
+      bool createContext(int bufferSize);
+
+      // fills buf from m_position, returns the bytes read, 0 at the end of the file or a
+      // negative AVERROR
+      virtual int read(uint8_t* buf, int size) = 0;
+      // called after every seek, a backend that reads ahead restarts from here
+      virtual void seeked() {}
+
+      int m_fd;
+      int64_t m_size;
+      int64_t m_position;
+
+    private:
+      static int readPacket(void* opaque, uint8_t* buf, int size);
+      static int64_t seek(void* opaque, int64_t offset, int whence);
+
+      FileIO(const FileIO&) = delete;
+      FileIO& operator=(const FileIO&) = delete;
+
+      AVIOContext* m_context;
+   };
+
+}}  // namespace challenge::media
@@ -0,0 +1,149 @@
+#include "frame-pool.hpp"
+#include <spdlog/spdlog.h>
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+namespace challenge { namespace media {
+   FramePool& FramePool::Instance() {
+      static FramePool instance;
+      return instance;
+   }
+
+   FramePool::Layout::Layout() : planes(0) {
+      for (int i = 0; i < 4; i++) {
+         linesize[i] = 0;
+         planeSize[i] = 0;
+         pools[i] = nullptr;
+      }
+   }
+
+   FramePool::Layout::~Layout() {
+      // buffers still in use keep their pool alive until they are released
+      for (int i = 0; i < 4; i++) {
+         av_buffer_pool_uninit(&pools[i]);
+      }
+   }
+
+   FramePool::FramePool() {}
+
+   FramePool::~FramePool() {}
+
+   FramePool::Layout* FramePool::layout(int w, int h, AVPixelFormat pixelFormat,
+                                        const int* linesizeAlign) {
+      Key key{w, h, pixelFormat, {linesizeAlign[0], linesizeAlign[1], linesizeAlign[2],
+                                  linesizeAlign[3]}};
+      std::unique_lock<std::mutex> lock(m_mutex);
+      auto iter = m_layouts.find(key);
+      if (iter != m_layouts.end()) {
+         return iter->second.get();
+      }
+
+      auto desc = av_pix_fmt_desc_get(pixelFormat);
+      if (desc == nullptr || (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL))) {
+         return nullptr;
+      }
+
+      // widen the picture until every linesize is aligned, the same way libavcodec does it
+      auto newLayout = std::make_unique<Layout>();
+      int alignedWidth = w;
+      bool unaligned = false;
+      do {
+         if (av_image_fill_linesizes(newLayout->linesize, pixelFormat, alignedWidth) < 0) {
+            return nullptr;
+         }
+         alignedWidth += alignedWidth & ~(alignedWidth - 1);
+         unaligned = false;
+         for (int i = 0; i < 4; i++) {
+            unaligned |= (newLayout->linesize[i] % linesizeAlign[i]) != 0;
+         }
+      } while (unaligned);
+
+      for (int i = 0; i < 4 && newLayout->linesize[i] > 0; i++) {
+         int planeHeight = h;
+         if (i == 1 || i == 2) {
+            planeHeight = -((-h) >> desc->log2_chroma_h);
+         }
+         newLayout->planeSize[i] = newLayout->linesize[i] * planeHeight;
+         newLayout->pools[i] =
+             av_buffer_pool_init(newLayout->planeSize[i] + PLANE_PADDING, av_buffer_allocz);
+         if (newLayout->pools[i] == nullptr) {
+            return nullptr;
+         }
+         newLayout->planes = i + 1;
+      }
+      spdlog::debug("frame pool: new layout {}x{} format {} with {} planes", w, h,
+                    int(pixelFormat), newLayout->planes);
+
+      auto result = newLayout.get();
+      m_layouts.emplace(key, std::move(newLayout));
+      return result;
+   }
+
+   bool FramePool::fill(AVFrame* frame, Layout* layout) {
+      for (int i = 0; i < layout->planes; i++) {
+         frame->buf[i] = av_buffer_pool_get(layout->pools[i]);
+         if (frame->buf[i] == nullptr) {
+            return false;
+         }
+         frame->data[i] = frame->buf[i]->data;
+         frame->linesize[i] = layout->linesize[i];
+      }
+      frame->extended_data = frame->data;
+      return true;
+   }
+
+   FramePtr FramePool::Get(int w, int h, AVPixelFormat pixelFormat) {
+      const int align[4] = {DEFAULT_ALIGN, DEFAULT_ALIGN, DEFAULT_ALIGN, DEFAULT_ALIGN};
+      auto frameLayout = layout(w, h, pixelFormat, align);
+      if (frameLayout == nullptr) {
+         return nullptr;
+      }
+      AVFrame* avframe = av_frame_alloc();
+      if (avframe == nullptr) {
+         return nullptr;
+      }
+      avframe->width = w;
+      avframe->height = h;
+      avframe->format = pixelFormat;
+      if (!fill(avframe, frameLayout)) {
+         av_frame_free(&avframe);
+         return nullptr;
+      }
+      return std::make_shared<Frame>(Frame::constructor_access{}, avframe);
+   }
+
+   void FramePool::Attach(AVCodecContext* codecContext) {
+      if (codecContext == nullptr || codecContext->codec == nullptr) {
+         return;
+      }
+      if (!(codecContext->codec->capabilities & AV_CODEC_CAP_DR1)) {
+         // the decoder can not write into buffers it did not allocate itself
+         return;
+      }
+      codecContext->opaque = this;
+      codecContext->get_buffer2 = getBuffer2;
+   }
+
+   int FramePool::getBuffer2(AVCodecContext* codecContext, AVFrame* frame, int flags) {
+      auto pool = static_cast<FramePool*>(codecContext->opaque);
+      if (pool == nullptr) {
+         return avcodec_default_get_buffer2(codecContext, frame, flags);
+      }
+
+      int w = frame->width;
+      int h = frame->height;
+      int linesizeAlign[AV_NUM_DATA_POINTERS];
+      avcodec_align_dimensions2(codecContext, &w, &h, linesizeAlign);
+
+      auto frameLayout = pool->layout(w, h, AVPixelFormat(frame->format), linesizeAlign);
+      if (frameLayout == nullptr) {
+         return avcodec_default_get_buffer2(codecContext, frame, flags);
+      }
+      if (!pool->fill(frame, frameLayout)) {
+         av_frame_unref(frame);
+         return AVERROR(ENOMEM);
+      }
+      return 0;
+   }
+}}  // namespace challenge::media
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "ffmpeg.h"
+#include "frame.hpp"
+
+namespace challenge { namespace media {
+   // Hands out frames whose planes come from AVBufferPools, one set of pools per
+   // (width, height, pixel format, linesize alignment). The planes go back to their pool when
+   // the last reference to the frame is released, so steady streams stop allocating picture
+   // memory.
+   // It can also be installed as get_buffer2 of a decoder, which then decodes straight into
+   // pooled memory.
+   class FramePool {
+    public:
+      // shared by everything that needs owned frames without a pool of its own
+      static FramePool& Instance();
+
+      FramePool();
+      ~FramePool();
+
+      FramePtr Get(int w, int h, AVPixelFormat pixelFormat);
+
+      // makes the decoder allocate its pictures from this pool, the pool must outlive the
+      // decoder's use of it (the buffers themselves may outlive both)
+      void Attach(AVCodecContext* codecContext);
+
+    private:
+      FramePool(const FramePool&) = delete;
+      FramePool& operator=(const FramePool&) = delete;
+
+      static const int DEFAULT_ALIGN = 32;
+      // extra bytes behind every plane, some decoders read a little past the end
+      static const int PLANE_PADDING = 16 + 64;
+
+      struct Key {
+         int width;
+         int height;
+         AVPixelFormat pixelFormat;
+         // decoders ask for different linesize alignments, a layout only fits its own
+         int linesizeAlign[4];
+
+         bool operator==(const Key& other) const {
+            return width == other.width && height == other.height &&
+                   pixelFormat == other.pixelFormat &&
+                   std::equal(linesizeAlign, linesizeAlign + 4, other.linesizeAlign);
+         }
+      };
+
+      struct KeyHash {
+         size_t operator()(const Key& key) const {
+            size_t hash =
+                (size_t(key.width) * 31 + size_t(key.height)) * 31 + size_t(key.pixelFormat);
+            for (int i = 0; i < 4; i++) {
+               hash = hash * 31 + size_t(key.linesizeAlign[i]);
+            }
+            return hash;
+         }
+      };
+
+      struct Layout {
+         int planes;
+         int linesize[4];
+         int planeSize[4];
+         AVBufferPool* pools[4];
+
+         Layout();
+         ~Layout();
+      };
+
+      static int getBuffer2(AVCodecContext* codecContext, AVFrame* frame, int flags);
+
+      // the pools for a picture of w x h, linesizes are multiples of linesizeAlign
+      Layout* layout(int w, int h, AVPixelFormat pixelFormat, const int* linesizeAlign);
+      bool fill(AVFrame* frame, Layout* layout);
+
+      std::mutex m_mutex;
+      std::unordered_map<Key, std::unique_ptr<Layout>, KeyHash> m_layouts;
+   };
+}}  // namespace challenge::media
@@ -1,4 +1,5 @@
 #include "frame.hpp"
+#include "frame-pool.hpp"
 #include <string>
 #include <memory>
 #include "ffmpeg.h"
@@ -16,15 +17,29 @@ namespace challenge { namespace media {
    }
 
    std::shared_ptr<Frame> Frame::Create(int w, int h, AVPixelFormat pixelFormat, bool isPlanar) {
+      if (isPlanar) {
+         auto frame = FramePool::Instance().Get(w, h, pixelFormat);
+         if (frame) {
+            return frame;
+         }
+      }
       return std::make_shared<Frame>(constructor_access{}, w, h, pixelFormat, isPlanar);
    }
 
    std::shared_ptr<Frame> Frame::CreateFromAVFrame(AVFrame* avframe) {
-      return std::make_shared<Frame>(constructor_access{}, avframe);
+      if (avframe == nullptr) {
+         return nullptr;
+      }
+      AVFrame* frame = av_frame_alloc();
+      if (frame == nullptr) {
+         return nullptr;
+      }
+      av_frame_move_ref(frame, avframe);
+      return std::make_shared<Frame>(constructor_access{}, frame);
    }
 
    Frame::Frame(constructor_access, int w, int h, AVPixelFormat pixelFormat, bool isPlanar)
-       : m_isKeyFrame(false) {
+       : m_isKeyFrame(false), m_ownsPlanes(true) {
       m_avFrame = av_frame_alloc();
       m_avFrame->width = w;
       m_avFrame->height = h;
@@ -40,12 +55,13 @@ namespace challenge { namespace media {
       }
    }
 
-   Frame::Frame(constructor_access, AVFrame* avframe) : m_avFrame(avframe), m_isKeyFrame(false) {
+   Frame::Frame(constructor_access, AVFrame* avframe)
+       : m_avFrame(avframe), m_isKeyFrame(avframe->key_frame != 0), m_ownsPlanes(false) {
       m_dataSize = GetDataSize(avframe->width, avframe->height, (AVPixelFormat)avframe->format);
    }
 
    Frame::~Frame() {
-      if (m_avFrame != nullptr) {
+      if (m_avFrame != nullptr && m_ownsPlanes) {
          if (m_avFrame->data[0] != nullptr) {
             av_freep(&m_avFrame->data[0]);
             m_avFrame->data[0] = nullptr;
@@ -60,6 +76,9 @@ namespace challenge { namespace media {
             av_freep(&m_avFrame->data[2]);
             m_avFrame->data[2] = nullptr;
          }
+      }
+      if (m_avFrame != nullptr) {
+         // releases the buffer references of a wrapped frame
          av_frame_free(&m_avFrame);
          m_avFrame = nullptr;
       }
@@ -123,6 +142,13 @@ namespace challenge { namespace media {
       return count + 1;
    }
 
+   AVPictureType Frame::PictureType() const {
+      if (m_avFrame == nullptr) {
+         return AV_PICTURE_TYPE_NONE;
+      }
+      return m_avFrame->pict_type;
+   }
+
    int64_t Frame::PTS() const {
       if (m_avFrame == nullptr) {
          return 0;
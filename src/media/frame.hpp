@@ -8,12 +8,16 @@
 namespace challenge { namespace media {
    class Frame {
       struct constructor_access {};
+      friend class FramePool;
 
     public:
       static uint32_t GetDataSize(int w, int h, AVPixelFormat pixelFormat);
       static uint32_t GetPlaneSize(int w, int h, AVPixelFormat pixelFormat, uint32_t planeNumber);
 
+      // planar frames come from FramePool::Instance(), their planes are recycled on release
       static std::shared_ptr<Frame> Create(int w, int h, AVPixelFormat pixelFormat, bool isPlanar);
+      // moves the refcounted buffers of avframe into the new frame without copying any pixels,
+      // avframe is left blank and can be handed back to the decoder
       static std::shared_ptr<Frame> CreateFromAVFrame(AVFrame *avframe);
 
       Frame(constructor_access access, int w, int h, AVPixelFormat pixelFormat, bool isPlanar);
@@ -34,6 +38,9 @@ namespace challenge { namespace media {
          m_isKeyFrame = true;
       }
 
+      // I, P or B as reported by the decoder
+      AVPictureType PictureType() const;
+
       uint8_t *Data(int plane = 0) const;
 
       int Stride(int plane) const;
@@ -59,6 +66,8 @@ namespace challenge { namespace media {
 
       AVFrame *m_avFrame;
       bool m_isKeyFrame;
+      // planes allocated by Create, wrapped frames release their buffers through av_frame_free
+      bool m_ownsPlanes;
       uint32_t m_dataSize;
 
    };
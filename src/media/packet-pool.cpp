@@ -0,0 +1,115 @@
+#include "packet-pool.hpp"
+#include <algorithm>
+#include <new>
+
+namespace challenge { namespace media {
+   PacketPool& PacketPool::Instance() {
+      // never destroyed, packets may still be released while the process exits
+      static PacketPool* instance = new PacketPool();
+      return *instance;
+   }
+
+   PacketPool::PacketPool()
+       : m_packetHits(0)
+       , m_packetMisses(0)
+       , m_bufferGets(0)
+       , m_bufferMisses(0) {
+      for (int bits = MIN_CLASS_BITS; bits <= MAX_CLASS_BITS; bits++) {
+         auto& sizeClass = m_classes[bits - MIN_CLASS_BITS];
+         sizeClass.owner = this;
+         sizeClass.size = 1 << bits;
+         sizeClass.pool = av_buffer_pool_init2(sizeClass.size, &sizeClass, allocClassBuffer, nullptr);
+      }
+   }
+
+   PacketPool::~PacketPool() {
+      for (auto& sizeClass : m_classes) {
+         av_buffer_pool_uninit(&sizeClass.pool);
+      }
+      for (auto mem : m_packets) {
+         ::operator delete(mem);
+      }
+   }
+
+   PacketPool::LocalCache::~LocalCache() {
+      // hand the cached objects of an exiting thread to the others
+      auto& pool = PacketPool::Instance();
+      std::unique_lock<std::mutex> lock(pool.m_mutex);
+      pool.m_packets.insert(pool.m_packets.end(), packets.begin(), packets.end());
+      packets.clear();
+   }
+
+   PacketPool::LocalCache& PacketPool::localCache() {
+      thread_local LocalCache cache;
+      return cache;
+   }
+
+   void* PacketPool::AllocatePacket(size_t size) {
+      auto& cache = localCache();
+      if (cache.packets.empty()) {
+         std::unique_lock<std::mutex> lock(m_mutex);
+         size_t count = std::min(m_packets.size(), TRANSFER_BATCH);
+         cache.packets.insert(cache.packets.end(), m_packets.end() - count, m_packets.end());
+         m_packets.resize(m_packets.size() - count);
+      }
+      if (cache.packets.empty()) {
+         m_packetMisses.fetch_add(1, std::memory_order_relaxed);
+         return ::operator new(size);
+      }
+      m_packetHits.fetch_add(1, std::memory_order_relaxed);
+      void* mem = cache.packets.back();
+      cache.packets.pop_back();
+      return mem;
+   }
+
+   void PacketPool::ReleasePacket(void* mem) {
+      if (mem == nullptr) {
+         return;
+      }
+      auto& cache = localCache();
+      cache.packets.push_back(mem);
+      if (cache.packets.size() >= LOCAL_CACHE_SIZE) {
+         // packets are usually released on another thread than the one allocating them,
+         // so move a batch where the allocating thread can pick it up
+         std::unique_lock<std::mutex> lock(m_mutex);
+         m_packets.insert(m_packets.end(), cache.packets.end() - TRANSFER_BATCH,
+                          cache.packets.end());
+         cache.packets.resize(cache.packets.size() - TRANSFER_BATCH);
+      }
+   }
+
+   AVBufferRef* PacketPool::AllocateBuffer(uint32_t size) {
+      m_bufferGets.fetch_add(1, std::memory_order_relaxed);
+      int bits = MIN_CLASS_BITS;
+      while (bits <= MAX_CLASS_BITS && (uint32_t(1) << bits) < size) {
+         bits++;
+      }
+      if (bits > MAX_CLASS_BITS) {
+         m_bufferMisses.fetch_add(1, std::memory_order_relaxed);
+         return av_buffer_alloc(int(size));
+      }
+      auto& sizeClass = m_classes[bits - MIN_CLASS_BITS];
+      if (sizeClass.pool == nullptr) {
+         m_bufferMisses.fetch_add(1, std::memory_order_relaxed);
+         return av_buffer_alloc(sizeClass.size);
+      }
+      return av_buffer_pool_get(sizeClass.pool);
+   }
+
+   AVBufferRef* PacketPool::allocClassBuffer(void* opaque, int size) {
+      // only called when the size class has no free buffer left
+      auto sizeClass = static_cast<SizeClass*>(opaque);
+      sizeClass->owner->m_bufferMisses.fetch_add(1, std::memory_order_relaxed);
+      return av_buffer_alloc(size);
+   }
+
+   PacketPoolStats PacketPool::Stats() const {
+      PacketPoolStats stats;
+      stats.packetHits = m_packetHits.load(std::memory_order_relaxed);
+      stats.packetMisses = m_packetMisses.load(std::memory_order_relaxed);
+      auto gets = m_bufferGets.load(std::memory_order_relaxed);
+      stats.bufferMisses = m_bufferMisses.load(std::memory_order_relaxed);
+      stats.bufferHits = gets > stats.bufferMisses ? gets - stats.bufferMisses : 0;
+      return stats;
+   }
+}}  // namespace challenge::media
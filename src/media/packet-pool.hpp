@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "ffmpeg.h"
+
+namespace challenge { namespace media {
+   struct PacketPoolStats {
+      uint64_t packetHits;
+      uint64_t packetMisses;
+      uint64_t bufferHits;
+      uint64_t bufferMisses;
+   };
+
+   // Recycles Packet objects and their payload buffers so a long running stream stops
+   // allocating once the pool has warmed up.
+   // Packet objects are kept in per-thread free lists which spill into a shared list, payloads
+   // come from power-of-two size classes each backed by an AVBufferPool.
+   class PacketPool {
+    public:
+      static const int MIN_CLASS_BITS = 10;  // 1KB
+      static const int MAX_CLASS_BITS = 24;  // 16MB, bigger buffers are not pooled
+
+      static PacketPool& Instance();
+
+      // raw memory for one Packet object
+      void* AllocatePacket(size_t size);
+      void ReleasePacket(void* mem);
+
+      // a buffer of at least size bytes, it goes back to its size class when the last
+      // reference is released
+      AVBufferRef* AllocateBuffer(uint32_t size);
+
+      PacketPoolStats Stats() const;
+
+    private:
+      PacketPool();
+      ~PacketPool();
+
+      PacketPool(const PacketPool&) = delete;
+      PacketPool& operator=(const PacketPool&) = delete;
+
+      struct SizeClass {
+         PacketPool* owner;
+         AVBufferPool* pool;
+         int size;
+      };
+
+      struct LocalCache {
+         std::vector<void*> packets;
+         ~LocalCache();
+      };
+
+      static const size_t LOCAL_CACHE_SIZE = 256;
+      static const size_t TRANSFER_BATCH = 64;
+
+      static AVBufferRef* allocClassBuffer(void* opaque, int size);
+      static LocalCache& localCache();
+
+      std::mutex m_mutex;
+      std::vector<void*> m_packets;
+      SizeClass m_classes[MAX_CLASS_BITS - MIN_CLASS_BITS + 1];
+
+      std::atomic<uint64_t> m_packetHits;
+      std::atomic<uint64_t> m_packetMisses;
+      std::atomic<uint64_t> m_bufferGets;
+      std::atomic<uint64_t> m_bufferMisses;
+   };
+}}  // namespace challenge::media
@@ -1,14 +1,30 @@
 #include "packet.hpp"
+#include "packet-pool.hpp"
 #include <string.h>
+#include <algorithm>
+#include <new>
 
 namespace challenge { namespace media {
 
-   Packet::Ptr Packet::MakeVideoPacket(int64_t newId, uint32_t _capacity /*= DEFAULT_PACKET_CAPACITY*/) {
-      return std::make_unique<Packet>(constructor_accessor{}, newId, _capacity, PacketFlags::VideoPacket);
+   void PacketDeleter::operator()(Packet* pkt) const {
+      if (pkt == nullptr) {
+         return;
+      }
+      pkt->~Packet();
+      PacketPool::Instance().ReleasePacket(pkt);
+   }
+
+   Packet::Ptr Packet::create(int64_t newId, PacketFlags flag) {
+      void* mem = PacketPool::Instance().AllocatePacket(sizeof(Packet));
+      return Ptr(new (mem) Packet(constructor_accessor{}, newId, 0, flag));
+   }
+
+   Packet::Ptr Packet::MakeVideoPacket(int64_t newId, uint32_t /*_capacity = DEFAULT_PACKET_CAPACITY*/) {
+      return create(newId, PacketFlags::VideoPacket);
    }
 
-   Packet::Ptr Packet::MakeAudioPacket(int64_t newId, uint32_t _capacity /*= DEFAULT_PACKET_CAPACITY*/) {
-      return std::make_unique<Packet>(constructor_accessor{}, newId, _capacity, PacketFlags::AudioPacket);
+   Packet::Ptr Packet::MakeAudioPacket(int64_t newId, uint32_t /*_capacity = DEFAULT_PACKET_CAPACITY*/) {
+      return create(newId, PacketFlags::AudioPacket);
    }
 
    Packet::Ptr Packet::CreateFromAVPacket(int64_t newId, const ::AVPacket* pkt, PacketFlags flag) {
@@ -16,7 +32,7 @@ namespace challenge { namespace media {
          return Packet::Ptr{};
       }
 
-      auto packet = std::make_unique<Packet>(constructor_accessor{}, pkt->size + 100, flag);
+      auto packet = create(newId, flag);
       packet->Store(pkt->data, pkt->size);
       packet->PTS(pkt->pts);
       packet->StreamId(pkt->stream_index);
@@ -31,6 +47,37 @@ namespace challenge { namespace media {
       return packet;
    }
 
+   Packet::Ptr Packet::CreateFromAVPacketRef(int64_t newId, const ::AVPacket* pkt, PacketFlags flag) {
+      if (pkt == nullptr || pkt->size < 2) {
+         return Packet::Ptr{};
+      }
+      if (pkt->buf == nullptr) {
+         // not refcounted, the data is only valid until the next av_read_frame
+         return CreateFromAVPacket(newId, pkt, flag);
+      }
+
+      auto packet = create(newId, flag);
+      packet->m_buffer = av_buffer_ref(pkt->buf);
+      if (packet->m_buffer == nullptr) {
+         return CreateFromAVPacket(newId, pkt, flag);
+      }
+      packet->m_data = pkt->data;
+      packet->m_size = pkt->size;
+      packet->m_capacity = pkt->size;
+      packet->checkData();
+      packet->PTS(pkt->pts);
+      packet->StreamId(pkt->stream_index);
+
+      packet->AddFlag(flag);
+      if (pkt->flags & AV_PKT_FLAG_KEY) {
+         packet->AddFlag(PacketFlags::HasKeyFrame);
+      }
+      if (pkt->flags & AV_PKT_FLAG_CORRUPT) {
+         packet->AddFlag(PacketFlags::IsCorrupted);
+      }
+      return packet;
+   }
+
    Packet::Packet(constructor_accessor accessor, int64_t newId, PacketFlags flag)
        : Packet(accessor, newId, DEFAULT_PACKET_CAPACITY, flag)  // 320KB
    {}
@@ -38,7 +85,8 @@ namespace challenge { namespace media {
    Packet::Packet(constructor_accessor,int64_t newId, uint32_t _capacity, PacketFlags flag)
        : m_size(0)
        , m_capacity(_capacity)
-       , m_data(_capacity)
+       , m_buffer(nullptr)
+       , m_data(nullptr)
        , m_id(newId)
        , m_nalUnit(NalUnitTypes::Unknown)
        , m_startCodeLength(0)
@@ -49,29 +97,62 @@ namespace challenge { namespace media {
        , m_duration(0)
        , m_dts(0) {}
 
-   Packet::~Packet() {}
+   Packet::~Packet() {
+      if (m_buffer != nullptr) {
+         av_buffer_unref(&m_buffer);
+      }
+   }
 
-   void Packet::Add(const uint8_t* _data, uint32_t length) {
-      if (m_data.size() < (m_size + length)) {
-         m_data.resize(m_size + length);
+   void Packet::makeWritable(uint32_t length, bool keepData) {
+      if (m_buffer != nullptr && length <= m_capacity && av_buffer_is_writable(m_buffer)) {
+         return;
+      }
+      uint32_t capacity = length;
+      if (m_buffer != nullptr && length > m_capacity) {
+         // growing, leave room for more Add calls
+         capacity = std::max(length, m_capacity * 2);
+      }
+      AVBufferRef* buffer =
+          PacketPool::Instance().AllocateBuffer(capacity + AV_INPUT_BUFFER_PADDING_SIZE);
+      if (buffer == nullptr) {
+         throw std::bad_alloc();
       }
-      memcpy(m_data.data() + m_size, _data, length);
+      if (keepData && m_size > 0) {
+         memcpy(buffer->data, m_data, m_size);
+      }
+      if (m_buffer != nullptr) {
+         // other packets may still read the old payload, they keep their own reference
+         av_buffer_unref(&m_buffer);
+      }
+      m_buffer = buffer;
+      m_data = buffer->data;
+      m_capacity = uint32_t(buffer->size - AV_INPUT_BUFFER_PADDING_SIZE);
+   }
+
+   uint8_t* Packet::WritableData() {
+      makeWritable(m_size, true);
+      return m_data;
+   }
+
+   void Packet::Add(const uint8_t* _data, uint32_t length) {
+      makeWritable(m_size + length, true);
+      memcpy(m_data + m_size, _data, length);
       m_size += length;
+      memset(m_data + m_size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
       checkData();
    }
 
    void Packet::Store(const uint8_t* _data, uint32_t length) {
-      if (m_data.size() < length) {
-         m_data.resize(length, false);
-      }
+      makeWritable(length, false);
       m_size = length;
-      memcpy(m_data.data(), _data, m_size);
+      memcpy(m_data, _data, m_size);
+      memset(m_data + m_size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
       checkData();
    }
 
    Packet::Ptr Packet::Clone() {
-      auto newPkt = std::make_unique<Packet>(constructor_accessor{}, m_capacity,
-                                             PacketFlags::VideoPacket);
+      auto newPkt = create(m_id, PacketFlags::VideoPacket);
+      newPkt->m_capacity = m_capacity;
       newPkt->m_flags = m_flags;
       newPkt->m_startCodeLength = m_startCodeLength;
       newPkt->m_pts = m_pts;
@@ -80,7 +161,16 @@ namespace challenge { namespace media {
       newPkt->m_streamId = m_streamId;
       newPkt->m_size = m_size;
       newPkt->m_duration = m_duration;
-      newPkt->m_data = m_data;
+      newPkt->m_nalUnit = m_nalUnit;
+      newPkt->m_metaData = m_metaData;
+      if (m_buffer != nullptr) {
+         // the payload is shared read-only, whoever writes to it first gets a private copy
+         newPkt->m_buffer = av_buffer_ref(m_buffer);
+         if (newPkt->m_buffer == nullptr) {
+            throw std::bad_alloc();
+         }
+         newPkt->m_data = m_data;
+      }
       return std::move(newPkt);
    }
 
@@ -96,7 +186,7 @@ namespace challenge { namespace media {
          return;
       }
 
-      uint8_t* packet = m_data.data();
+      const uint8_t* packet = m_data;
       m_startCodeLength = 0;
       if (packet[2] == 1 /*24bit start-code*/)
          m_startCodeLength = 3;
@@ -132,8 +222,11 @@ namespace challenge { namespace media {
    }
 
    void Packet::Clear() {
+      if (m_buffer != nullptr) {
+         av_buffer_unref(&m_buffer);
+      }
+      m_data = nullptr;
       m_size = 0;
-      m_data.clear();
       m_nalUnit = NalUnitTypes::Unknown;
       m_startCodeLength = 0;
       m_flags = 0;
@@ -16,22 +16,35 @@ namespace challenge { namespace media {
 
    enum class NalUnitTypes { Unknown, SEI, SPS, PPS, I_Frame, P_Frame, B_Frame };
 
+   class Packet;
+
+   // destroys the packet and gives its memory back to the PacketPool
+   struct PacketDeleter {
+      void operator()(Packet* pkt) const;
+   };
+
 
    class Packet {
     private:
       struct constructor_accessor {};
 
     public:
-      typedef std::unique_ptr<Packet> Ptr;
+      typedef std::unique_ptr<Packet, PacketDeleter> Ptr;
 
       static const uint32_t DEFAULT_PACKET_CAPACITY = 1024 * 240;  // 240KB
 
+      // the capacity is only a hint, the payload is taken from the PacketPool size class
+      // that fits what is actually stored
       static Ptr MakeVideoPacket(int64_t newId, uint32_t _capacity = DEFAULT_PACKET_CAPACITY);
 
       static Ptr MakeAudioPacket(int64_t newId, uint32_t _capacity = DEFAULT_PACKET_CAPACITY);
 
       static Ptr CreateFromAVPacket(int64_t newId, const ::AVPacket* pkt, PacketFlags flag);
 
+      // takes a new reference to the refcounted payload of pkt instead of copying it,
+      // the caller still owns pkt and can unref it right after this call
+      static Ptr CreateFromAVPacketRef(int64_t newId, const ::AVPacket* pkt, PacketFlags flag);
+
       static std::string PacketTypeToString(Ptr &pkt);
 
       Packet(constructor_accessor,int64_t newId, PacketFlags flag);
@@ -46,8 +59,17 @@ namespace challenge { namespace media {
       // memory if you want
       void Store(const uint8_t *_data, uint32_t length);
 
-      uint8_t *Data() {
-         return m_data.data();
+      // the payload may be shared with clones of this packet, so it is read-only
+      const uint8_t *Data() const {
+         return m_data;
+      }
+
+      // gives this packet a private copy of the payload first if it is shared
+      uint8_t *WritableData();
+
+      // the refcounted buffer behind Data(), clones of the packet reference the same one
+      AVBufferRef *Buffer() const {
+         return m_buffer;
       }
 
       int Size() const {
@@ -142,6 +164,7 @@ namespace challenge { namespace media {
          m_metaData = value;
       }
 
+      // the clone shares the payload with this packet and only copies the metadata
       Ptr Clone();
 
       void Clear();
@@ -149,6 +172,8 @@ namespace challenge { namespace media {
       std::string NalUnitTypeString() const;
 
     private:
+      static Ptr create(int64_t newId, PacketFlags flag);
+
       /* after start code which can be 3 bytes of 4 bytes start code:
        * int fragment_type = Data[0] & 0x1F;
        * int nal_type = Data[1] & 0x1F;
@@ -161,9 +186,17 @@ namespace challenge { namespace media {
        */
       void checkData();
 
+      // makes sure m_buffer is owned by this packet only and can hold length bytes,
+      // a shared payload is copied (keepData) or dropped first
+      void makeWritable(uint32_t length, bool keepData);
+
+      Packet(const Packet &packet);
+      Packet &operator=(const Packet &packet);
+
       uint32_t m_size;
       uint32_t m_capacity;
-      std::vector<uint8_t> m_data;
+      AVBufferRef *m_buffer;
+      uint8_t *m_data;
 
       NalUnitTypes m_nalUnit;
       int m_startCodeLength;
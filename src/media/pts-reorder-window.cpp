@@ -0,0 +1,64 @@
+#include "pts-reorder-window.hpp"
+#include <algorithm>
+
+namespace challenge { namespace media {
+
+   PtsReorderWindow::PtsReorderWindow(int depth)
+      : m_depth(0)
+      , m_hasReleased(false)
+      , m_lastReleased(0)
+      , m_frameDuration(0)
+      , m_lateCount(0) {
+      Reset(depth);
+   }
+
+   bool PtsReorderWindow::Push(int64_t pts) {
+      if (m_hasReleased && pts <= m_lastReleased) {
+         m_lateCount++;
+         m_depth = std::min(m_depth + 1, int(MAX_DEPTH));
+         return false;
+      }
+      m_heap.push(pts);
+      return true;
+   }
+
+   bool PtsReorderWindow::Discontinuity(int64_t pts) const {
+      // a packet can not be reordered by more than MAX_DEPTH frames
+      return m_hasReleased && m_frameDuration > 0 && pts < m_lastReleased - m_frameDuration * MAX_DEPTH;
+   }
+
+   bool PtsReorderWindow::Pop(int64_t& pts) {
+      if (int(m_heap.size()) <= m_depth) {
+         return false;
+      }
+      return Drain(pts);
+   }
+
+   bool PtsReorderWindow::Drain(int64_t& pts) {
+      if (m_heap.empty()) {
+         return false;
+      }
+      pts = m_heap.top();
+      m_heap.pop();
+      if (m_hasReleased && pts > m_lastReleased) {
+         m_frameDuration = pts - m_lastReleased;
+      }
+      m_lastReleased = pts;
+      m_hasReleased = true;
+      return true;
+   }
+
+   void PtsReorderWindow::Reset(int depth) {
+      m_depth = std::max(0, std::min(depth, int(MAX_DEPTH)));
+      m_lateCount = 0;
+      Restart();
+   }
+
+   void PtsReorderWindow::Restart() {
+      m_heap = decltype(m_heap)();
+      m_hasReleased = false;
+      m_lastReleased = 0;
+      m_frameDuration = 0;
+   }
+
+}}  // namespace challenge::media
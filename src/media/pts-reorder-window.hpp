@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <queue>
+#include <vector>
+
+namespace challenge { namespace media {
+
+   // Puts packet timestamps back into presentation order without decoding.
+   // Packets of a stream with B-frames arrive in decode order, so their pts jump back and forth.
+   // The window holds the last depth + 1 timestamps in a min-heap and releases the smallest one,
+   // which is the next frame to be presented as long as depth covers the stream's reorder delay.
+   // Each timestamp costs O(log depth).
+   class PtsReorderWindow {
+    public:
+      // H.264/HEVC can not reorder more than 16 frames
+      static const int MAX_DEPTH = 16;
+
+      explicit PtsReorderWindow(int depth = 0);
+
+      // false when pts is slightly older than a timestamp already released, the window was too
+      // small for this stream and it grows by one frame, the late pts itself is dropped.
+      // Check Discontinuity() first, a jump back is not a late packet
+      bool Push(int64_t pts);
+
+      // true when pts is further behind the last released timestamp than reordering can explain
+      // (a timestamp wrap, a looped file or a reconnect). Drain() what is pending and Restart()
+      // before pushing it
+      bool Discontinuity(int64_t pts) const;
+
+      // the next pts in presentation order, once more than Depth() timestamps are pending
+      bool Pop(int64_t& pts);
+
+      // releases whatever is still pending, for the end of the stream
+      bool Drain(int64_t& pts);
+
+      void Reset(int depth);
+
+      // forgets the released timestamps but keeps the depth learned so far, after a
+      // discontinuity
+      void Restart();
+
+      int Depth() const {
+         return m_depth;
+      }
+
+      int64_t LateCount() const {
+         return m_lateCount;
+      }
+
+    private:
+      std::priority_queue<int64_t, std::vector<int64_t>, std::greater<int64_t>> m_heap;
+      int m_depth;
+      bool m_hasReleased;
+      int64_t m_lastReleased;
+      // the last step between released timestamps, 0 until there is one
+      int64_t m_frameDuration;
+      int64_t m_lateCount;
+   };
+
+}}  // namespace challenge::media
@@ -0,0 +1,269 @@
+#include "stream-info-cache.hpp"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <vector>
+
+extern "C" {
+#include <libavutil/channel_layout.h>
+}
+
+// AVCodecParameters::channels and channel_layout gave way to ch_layout in FFmpeg 5.1
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 24, 100)
+#define CHALLENGE_HAVE_CH_LAYOUT 1
+#endif
+
+namespace challenge { namespace media {
+
+   namespace {
+      const int CACHE_VERSION = 1;
+
+      std::string toBase64(const uint8_t* data, int size) {
+         if (data == nullptr || size <= 0) {
+            return "-";
+         }
+         std::vector<char> text(AV_BASE64_SIZE(size));
+         av_base64_encode(text.data(), int(text.size()), data, size);
+         return std::string(text.data());
+      }
+
+      // start of the next Annex B start code at or after pos, size when there is none
+      size_t findStartCode(const uint8_t* data, size_t size, size_t pos) {
+         for (; pos + 3 <= size; pos++) {
+            if (data[pos] == 0 && data[pos + 1] == 0 && data[pos + 2] == 1) {
+               return pos;
+            }
+         }
+         return size;
+      }
+
+      int channelCount(const AVCodecParameters* par) {
+#ifdef CHALLENGE_HAVE_CH_LAYOUT
+         return par->ch_layout.nb_channels;
+#else
+         return par->channels;
+#endif
+      }
+
+      // 0 when the channels have no native layout
+      uint64_t channelMask(const AVCodecParameters* par) {
+#ifdef CHALLENGE_HAVE_CH_LAYOUT
+         return par->ch_layout.order == AV_CHANNEL_ORDER_NATIVE ? par->ch_layout.u.mask : 0;
+#else
+         return par->channel_layout;
+#endif
+      }
+
+      void setChannels(AVCodecParameters* par, int channels, uint64_t mask) {
+#ifdef CHALLENGE_HAVE_CH_LAYOUT
+         av_channel_layout_uninit(&par->ch_layout);
+         if (mask == 0 || av_channel_layout_from_mask(&par->ch_layout, mask) < 0) {
+            par->ch_layout.order = AV_CHANNEL_ORDER_UNSPEC;
+            par->ch_layout.nb_channels = channels;
+         }
+#else
+         par->channels = channels;
+         par->channel_layout = mask;
+#endif
+      }
+
+      bool isParameterSet(AVCodecID codecId, const uint8_t* nal) {
+         if (codecId == AV_CODEC_ID_H264) {
+            return (nal[0] & 0x1f) == 7;  // SPS
+         }
+         auto type = (nal[0] >> 1) & 0x3f;
+         return type == 32 || type == 33;  // VPS, SPS
+      }
+
+      // avcC/hvcC extradata (mp4, mkv) starts with version 1 and makes the packets length
+      // prefixed, the size of that prefix is stored in it. 0 means Annex B packets
+      int nalLengthSize(const AVCodecParameters* par) {
+         auto extradata = par->extradata;
+         if (extradata == nullptr || extradata[0] != 1) {
+            return 0;
+         }
+         if (par->codec_id == AV_CODEC_ID_H264 && par->extradata_size >= 7) {
+            return (extradata[4] & 0x03) + 1;
+         }
+         if (par->codec_id == AV_CODEC_ID_HEVC && par->extradata_size >= 23) {
+            return (extradata[21] & 0x03) + 1;
+         }
+         return 0;
+      }
+
+      // false for a parameter set the extradata does not contain
+      bool isKnown(const AVCodecParameters* par, const uint8_t* nal, const uint8_t* end) {
+         if (end <= nal || !isParameterSet(par->codec_id, nal)) {
+            return true;
+         }
+         auto extradata = par->extradata;
+         if (extradata == nullptr) {
+            return false;
+         }
+         auto extradataEnd = extradata + std::max(par->extradata_size, 0);
+         return std::search(extradata, extradataEnd, nal, end) != extradataEnd;
+      }
+   }  // namespace
+
+   StreamInfoCache::StreamInfoCache(std::string directory) : m_directory(directory) {}
+
+   std::string StreamInfoCache::pathOf(const std::string& uri) const {
+      std::stringstream path;
+      path << m_directory << "/" << std::hex << std::hash<std::string>()(uri) << ".streaminfo";
+      return path.str();
+   }
+
+   bool StreamInfoCache::Save(const std::string& uri, const AVFormatContext* fmtCtx) const {
+      std::ofstream file(pathOf(uri), std::ios::trunc);
+      if (!file) {
+         spdlog::warn("can not write the stream info cache to {}", m_directory);
+         return false;
+      }
+      file << "streaminfo " << CACHE_VERSION << " " << fmtCtx->nb_streams << "\n";
+      for (unsigned int i = 0; i < fmtCtx->nb_streams; i++) {
+         auto stream = fmtCtx->streams[i];
+         auto par = stream->codecpar;
+         file << int(par->codec_type) << " " << int(par->codec_id) << " " << par->codec_tag << " "
+              << par->format << " " << par->bit_rate << " " << par->profile << " " << par->level << " "
+              << par->width << " " << par->height << " " << par->sample_aspect_ratio.num << " "
+              << par->sample_aspect_ratio.den << " " << par->video_delay << " " << par->sample_rate << " "
+              << channelCount(par) << " " << channelMask(par) << " " << par->frame_size << " "
+              << stream->avg_frame_rate.num << " " << stream->avg_frame_rate.den << " "
+              << stream->r_frame_rate.num << " " << stream->r_frame_rate.den << " "
+              << toBase64(par->extradata, par->extradata_size) << "\n";
+      }
+      return bool(file);
+   }
+
+   bool StreamInfoCache::Load(const std::string& uri, AVFormatContext* fmtCtx) const {
+      std::ifstream file(pathOf(uri));
+      if (!file) {
+         return false;
+      }
+      std::string magic;
+      int version = 0;
+      unsigned int streamCount = 0;
+      file >> magic >> version >> streamCount;
+      if (magic != "streaminfo" || version != CACHE_VERSION || streamCount != fmtCtx->nb_streams) {
+         return false;
+      }
+
+      struct Entry {
+         int codecType, codecId;
+         AVCodecParameters par;
+         int channels;
+         uint64_t channelLayout;
+         AVRational avgFrameRate, realFrameRate;
+         std::string extradata;
+      };
+      std::vector<Entry> entries(streamCount);
+      for (unsigned int i = 0; i < streamCount; i++) {
+         auto& entry = entries[i];
+         auto& par = entry.par;
+         file >> entry.codecType >> entry.codecId >> par.codec_tag >> par.format >> par.bit_rate >>
+             par.profile >> par.level >> par.width >> par.height >> par.sample_aspect_ratio.num >>
+             par.sample_aspect_ratio.den >> par.video_delay >> par.sample_rate >> entry.channels >>
+             entry.channelLayout >> par.frame_size >> entry.avgFrameRate.num >> entry.avgFrameRate.den >>
+             entry.realFrameRate.num >> entry.realFrameRate.den >> entry.extradata;
+         if (!file) {
+            return false;
+         }
+         // the demuxer knows the stream layout after the header, the entry has to agree with it
+         auto current = fmtCtx->streams[i]->codecpar;
+         if ((current->codec_type != AVMEDIA_TYPE_UNKNOWN && current->codec_type != entry.codecType) ||
+             (current->codec_id != AV_CODEC_ID_NONE && current->codec_id != entry.codecId)) {
+            return false;
+         }
+      }
+
+      for (unsigned int i = 0; i < streamCount; i++) {
+         auto& entry = entries[i];
+         auto stream = fmtCtx->streams[i];
+         auto par = stream->codecpar;
+         par->codec_type = AVMediaType(entry.codecType);
+         par->codec_id = AVCodecID(entry.codecId);
+         par->codec_tag = entry.par.codec_tag;
+         par->format = entry.par.format;
+         par->bit_rate = entry.par.bit_rate;
+         par->profile = entry.par.profile;
+         par->level = entry.par.level;
+         par->width = entry.par.width;
+         par->height = entry.par.height;
+         par->sample_aspect_ratio = entry.par.sample_aspect_ratio;
+         par->video_delay = entry.par.video_delay;
+         par->sample_rate = entry.par.sample_rate;
+         setChannels(par, entry.channels, entry.channelLayout);
+         par->frame_size = entry.par.frame_size;
+         if (stream->avg_frame_rate.num == 0) {
+            stream->avg_frame_rate = entry.avgFrameRate;
+         }
+         if (stream->r_frame_rate.num == 0) {
+            stream->r_frame_rate = entry.realFrameRate;
+         }
+         // extradata the container carries itself is authoritative
+         if (par->extradata == nullptr && entry.extradata != "-") {
+            std::vector<uint8_t> decoded(entry.extradata.size());
+            auto size = av_base64_decode(decoded.data(), entry.extradata.c_str(), int(decoded.size()));
+            if (size > 0) {
+               par->extradata = static_cast<uint8_t*>(av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE));
+               if (par->extradata != nullptr) {
+                  std::copy(decoded.begin(), decoded.begin() + size, par->extradata);
+                  par->extradata_size = size;
+               }
+            }
+         }
+      }
+      return true;
+   }
+
+   void StreamInfoCache::Remove(const std::string& uri) const {
+      std::remove(pathOf(uri).c_str());
+   }
+
+   bool StreamInfoCache::MatchesKeyFrame(const AVPacket* pkt, const AVCodecParameters* codecpar) {
+      if (codecpar->codec_id != AV_CODEC_ID_H264 && codecpar->codec_id != AV_CODEC_ID_HEVC) {
+         return true;
+      }
+      const uint8_t* data = pkt->data;
+      size_t size = pkt->size > 0 ? size_t(pkt->size) : 0;
+      // the extradata tells the packet format, a NAL unit length prefix can look like a start code
+      auto lengthSize = size_t(nalLengthSize(codecpar));
+      if (lengthSize > 0) {
+         size_t pos = 0;
+         while (pos + lengthSize <= size) {
+            size_t nalSize = 0;
+            for (size_t i = 0; i < lengthSize; i++) {
+               nalSize = (nalSize << 8) | data[pos + i];
+            }
+            pos += lengthSize;
+            if (nalSize > size - pos) {
+               break;
+            }
+            if (!isKnown(codecpar, data + pos, data + pos + nalSize)) {
+               return false;
+            }
+            pos += nalSize;
+         }
+         return true;
+      }
+      auto pos = findStartCode(data, size, 0);
+      while (pos < size) {
+         auto nalStart = pos + 3;
+         auto nalEnd = findStartCode(data, size, nalStart);
+         auto end = nalEnd;
+         // the zero of a four byte start code belongs to the next one
+         while (end > nalStart && data[end - 1] == 0) {
+            end--;
+         }
+         if (!isKnown(codecpar, data + nalStart, data + end)) {
+            return false;
+         }
+         pos = nalEnd;
+      }
+      return true;
+   }
+
+}}  // namespace challenge::media
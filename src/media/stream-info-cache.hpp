@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include "ffmpeg.h"
+
+namespace challenge { namespace media {
+
+   // Remembers the codec parameters avformat_find_stream_info found for an input, one small
+   // text file per uri in a directory, so the next start can fill them in and skip the probing.
+   // The parameters of a live input can change between runs, so a hit is only a guess until
+   // MatchesKeyFrame() has compared it with the parameter sets of the first keyframe.
+   class StreamInfoCache {
+    public:
+      explicit StreamInfoCache(std::string directory);
+
+      // fills the streams of a freshly opened input from the cache, false when there is no
+      // entry or it does not fit the streams the demuxer reported
+      bool Load(const std::string& uri, AVFormatContext* fmtCtx) const;
+      bool Save(const std::string& uri, const AVFormatContext* fmtCtx) const;
+      void Remove(const std::string& uri) const;
+
+      // false when an H.264/HEVC keyframe carries a parameter set that is not in the cached
+      // extradata, anything that can not be checked counts as a match
+      static bool MatchesKeyFrame(const AVPacket* pkt, const AVCodecParameters* codecpar);
+
+    private:
+      std::string pathOf(const std::string& uri) const;
+
+      std::string m_directory;
+   };
+
+}}  // namespace challenge::media
@@ -0,0 +1,255 @@
+#include "uring-file-io.hpp"
+
+#ifdef CHALLENGE_HAVE_IO_URING
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace challenge { namespace media {
+
+   namespace {
+      int uringSetup(unsigned entries, io_uring_params* params) {
+         return int(syscall(__NR_io_uring_setup, entries, params));
+      }
+
+      int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+         return int(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+      }
+
+      template <typename T>
+      T* ringField(void* ring, unsigned offset) {
+         return reinterpret_cast<T*>(static_cast<uint8_t*>(ring) + offset);
+      }
+   }  // namespace
+
+   std::unique_ptr<FileIO> UringFileIO::Create(int fd, int64_t size, int chunkSize) {
+      std::unique_ptr<UringFileIO> io(new UringFileIO(fd, size, chunkSize));
+      if (!io->setup()) {
+         // the caller keeps the descriptor
+         io->m_fd = -1;
+         return nullptr;
+      }
+      return std::unique_ptr<FileIO>(io.release());
+   }
+
+   UringFileIO::UringFileIO(int fd, int64_t size, int chunkSize)
+      : FileIO(fd, size)
+      , m_chunkSize(chunkSize > 0 ? chunkSize : DEFAULT_BUFFER_SIZE)
+      , m_head(0)
+      , m_nextOffset(0)
+      , m_ringFd(-1)
+      , m_sqRing(MAP_FAILED)
+      , m_sqRingSize(0)
+      , m_cqRing(MAP_FAILED)
+      , m_cqRingSize(0)
+      , m_sqes(nullptr)
+      , m_sqesSize(0) {
+      m_memory.resize(size_t(m_chunkSize) * READ_AHEAD_CHUNKS);
+      for (int i = 0; i < READ_AHEAD_CHUNKS; i++) {
+         auto& chunk = m_chunks[i];
+         chunk.data = m_memory.data() + size_t(m_chunkSize) * i;
+         chunk.iov.iov_base = chunk.data;
+         chunk.iov.iov_len = size_t(m_chunkSize);
+         chunk.offset = -1;
+         chunk.length = 0;
+         chunk.error = 0;
+         chunk.inFlight = false;
+      }
+   }
+
+   UringFileIO::~UringFileIO() {
+      // the kernel writes into m_memory until every read has completed
+      if (m_ringFd >= 0) {
+         drain();
+      }
+      if (m_sqes != nullptr) {
+         munmap(m_sqes, m_sqesSize);
+      }
+      if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing) {
+         munmap(m_cqRing, m_cqRingSize);
+      }
+      if (m_sqRing != MAP_FAILED) {
+         munmap(m_sqRing, m_sqRingSize);
+      }
+      if (m_ringFd >= 0) {
+         close(m_ringFd);
+      }
+   }
+
+   bool UringFileIO::setup() {
+      io_uring_params params;
+      memset(&params, 0, sizeof(params));
+      m_ringFd = uringSetup(READ_AHEAD_CHUNKS, &params);
+      if (m_ringFd < 0) {
+         spdlog::info("io_uring is not available: {}", strerror(errno));
+         return false;
+      }
+
+      m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+#ifdef IORING_FEAT_SINGLE_MMAP
+      bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+#else
+      // headers of 5.1 to 5.3, the rings are always mapped separately there
+      bool singleMap = false;
+#endif
+      if (singleMap) {
+         m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+      }
+      m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      m_ringFd, IORING_OFF_SQ_RING);
+      if (m_sqRing == MAP_FAILED) {
+         return false;
+      }
+      if (singleMap) {
+         m_cqRing = m_sqRing;
+      } else {
+         m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         m_ringFd, IORING_OFF_CQ_RING);
+         if (m_cqRing == MAP_FAILED) {
+            return false;
+         }
+      }
+      m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+      auto sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd,
+                       IORING_OFF_SQES);
+      if (sqes == MAP_FAILED) {
+         return false;
+      }
+      m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+      m_sqHead = ringField<unsigned>(m_sqRing, params.sq_off.head);
+      m_sqTail = ringField<unsigned>(m_sqRing, params.sq_off.tail);
+      m_sqMask = ringField<unsigned>(m_sqRing, params.sq_off.ring_mask);
+      m_sqArray = ringField<unsigned>(m_sqRing, params.sq_off.array);
+      m_cqHead = ringField<unsigned>(m_cqRing, params.cq_off.head);
+      m_cqTail = ringField<unsigned>(m_cqRing, params.cq_off.tail);
+      m_cqMask = ringField<unsigned>(m_cqRing, params.cq_off.ring_mask);
+      m_cqes = ringField<io_uring_cqe>(m_cqRing, params.cq_off.cqes);
+      return true;
+   }
+
+   void UringFileIO::submit(int index, int64_t offset) {
+      auto& chunk = m_chunks[index];
+      chunk.offset = offset;
+      chunk.length = 0;
+      chunk.error = 0;
+      chunk.inFlight = true;
+
+      // we never have more reads queued than the ring has entries, so there is always room
+      auto tail = *m_sqTail;
+      auto slot = tail & *m_sqMask;
+      auto& sqe = m_sqes[slot];
+      memset(&sqe, 0, sizeof(sqe));
+      // READV instead of READ, it is there since the first io_uring kernels
+      sqe.opcode = IORING_OP_READV;
+      sqe.fd = m_fd;
+      sqe.addr = reinterpret_cast<uint64_t>(&chunk.iov);
+      sqe.len = 1;
+      sqe.off = uint64_t(offset);
+      sqe.user_data = uint64_t(index);
+      m_sqArray[slot] = slot;
+      __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+
+      int ret;
+      while ((ret = uringEnter(m_ringFd, 1, 0, 0)) < 0 && errno == EINTR) {
+      }
+      if (ret < 1 && __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) == tail) {
+         // the kernel did not take the entry and no completion will come for it, so it must not
+         // count as in flight. read() falls back to pread for this chunk
+         chunk.inFlight = false;
+         chunk.error = ret < 0 ? errno : EIO;
+         __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+      }
+   }
+
+   void UringFileIO::waitForCompletion() {
+      auto head = *m_cqHead;
+      if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)) {
+         while (uringEnter(m_ringFd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno == EINTR) {
+         }
+      }
+      while (head != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)) {
+         auto& cqe = m_cqes[head & *m_cqMask];
+         auto& chunk = m_chunks[cqe.user_data];
+         chunk.inFlight = false;
+         if (cqe.res < 0) {
+            chunk.error = -cqe.res;
+         } else {
+            chunk.length = cqe.res;
+         }
+         head++;
+      }
+      __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+   }
+
+   void UringFileIO::drain() {
+      for (int i = 0; i < READ_AHEAD_CHUNKS; i++) {
+         while (m_chunks[i].inFlight) {
+            waitForCompletion();
+         }
+      }
+   }
+
+   void UringFileIO::startReadAhead(int64_t offset) {
+      drain();
+      m_head = 0;
+      m_nextOffset = offset;
+      for (int i = 0; i < READ_AHEAD_CHUNKS; i++) {
+         if (m_nextOffset < m_size) {
+            submit(i, m_nextOffset);
+            m_nextOffset += m_chunkSize;
+         } else {
+            m_chunks[i].offset = -1;
+         }
+      }
+   }
+
+   int UringFileIO::read(uint8_t* buf, int size) {
+      auto* chunk = &m_chunks[m_head];
+      if (chunk->offset < 0 || m_position < chunk->offset ||
+          m_position >= chunk->offset + m_chunkSize) {
+         startReadAhead(m_position);
+         chunk = &m_chunks[m_head];
+      }
+      while (chunk->inFlight) {
+         waitForCompletion();
+      }
+      if (chunk->error != 0) {
+         // retry this read synchronously, the next one starts a fresh read ahead
+         auto error = chunk->error;
+         chunk->offset = -1;
+         auto ret = ::pread(m_fd, buf, size_t(size), off_t(m_position));
+         return ret >= 0 ? int(ret) : AVERROR(error);
+      }
+      auto available = chunk->offset + chunk->length - m_position;
+      if (available <= 0) {
+         // a short read that was not the end of the file, read ahead from here again
+         if (chunk->offset + chunk->length < m_size) {
+            chunk->offset = -1;
+            return read(buf, size);
+         }
+         return 0;
+      }
+      auto count = available < size ? int(available) : size;
+      memcpy(buf, chunk->data + (m_position - chunk->offset), size_t(count));
+      if (count == available) {
+         // the chunk is used up, send it after the last one in flight
+         if (m_nextOffset < m_size) {
+            submit(m_head, m_nextOffset);
+            m_nextOffset += m_chunkSize;
+         } else {
+            chunk->offset = -1;
+         }
+         m_head = (m_head + 1) % READ_AHEAD_CHUNKS;
+      }
+      return count;
+   }
+
+}}  // namespace challenge::media
+#endif
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "file-io.hpp"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define CHALLENGE_HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef CHALLENGE_HAVE_IO_URING
+#include <sys/uio.h>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace challenge { namespace media {
+
+   // Reads a file through io_uring, keeping READ_AHEAD_CHUNKS reads of chunkSize bytes in flight
+   // ahead of the demuxer so the disk always has work queued while we parse.
+   // The ring is driven with the raw syscalls, there is no dependency on liburing.
+   // A seek out of the chunks already read throws the read ahead away and starts over there.
+   class UringFileIO : public FileIO {
+    public:
+      static const int READ_AHEAD_CHUNKS = 4;
+
+      // nullptr when the kernel (or a seccomp filter) does not allow io_uring, fd is only
+      // taken over on success.
+      static std::unique_ptr<FileIO> Create(int fd, int64_t size, int chunkSize);
+
+      ~UringFileIO();
+
+    protected:
+      int read(uint8_t* buf, int size) override;
+
+    private:
+      struct Chunk {
+         uint8_t* data;
+         iovec iov;
+         int64_t offset;  // -1 when the chunk holds nothing
+         int length;
+         int error;
+         bool inFlight;
+      };
+
+      UringFileIO(int fd, int64_t size, int chunkSize);
+
+      bool setup();
+      void startReadAhead(int64_t offset);
+      void submit(int index, int64_t offset);
+      void waitForCompletion();
+      void drain();
+
+      int m_chunkSize;
+      int m_head;
+      int64_t m_nextOffset;
+      std::vector<uint8_t> m_memory;
+      Chunk m_chunks[READ_AHEAD_CHUNKS];
+
+      int m_ringFd;
+      void* m_sqRing;
+      size_t m_sqRingSize;
+      void* m_cqRing;
+      size_t m_cqRingSize;
+      io_uring_sqe* m_sqes;
+      size_t m_sqesSize;
+      unsigned* m_sqHead;
+      unsigned* m_sqTail;
+      unsigned* m_sqMask;
+      unsigned* m_sqArray;
+      unsigned* m_cqHead;
+      unsigned* m_cqTail;
+      unsigned* m_cqMask;
+      io_uring_cqe* m_cqes;
+   };
+
+}}  // namespace challenge::media
+#endif
@@ -2,6 +2,31 @@
 #include <spdlog/spdlog.h>
 
 namespace challenge { namespace media {
+   DecoderOptions DecoderOptions::Throughput() {
+      DecoderOptions options;
+      options.threading = DecoderThreading::FrameAndSlice;
+      options.threadCount = 0;
+      options.lowDelay = false;
+      return options;
+   }
+
+   DecoderOptions DecoderOptions::LowLatency() {
+      DecoderOptions options;
+      options.threading = DecoderThreading::Slice;
+      options.threadCount = 0;
+      options.lowDelay = true;
+      return options;
+   }
+
+   static int threadType(DecoderThreading threading) {
+      switch (threading) {
+         case DecoderThreading::Frame: return FF_THREAD_FRAME;
+         case DecoderThreading::Slice: return FF_THREAD_SLICE;
+         case DecoderThreading::FrameAndSlice: return FF_THREAD_FRAME | FF_THREAD_SLICE;
+         default: return 0;
+      }
+   }
+
    VideoDecoder::VideoDecoder()
        : m_isReady(false)
        , m_needToStop(false)
@@ -12,7 +37,8 @@ namespace challenge { namespace media {
       Close();
    }
 
-   bool VideoDecoder::Open(FrameCallback callback, AVCodecParameters* codecParams, AVRational time_base) {
+   bool VideoDecoder::Open(FrameCallback callback, AVCodecParameters* codecParams, AVRational time_base,
+                           const DecoderOptions& options) {
       if (codecParams == nullptr) {
          return false;
       }
@@ -32,7 +58,21 @@ namespace challenge { namespace media {
       if (m_codec->capabilities & AV_CODEC_CAP_TRUNCATED)
          m_codecContext->flags |= AV_CODEC_FLAG_TRUNCATED;  // we do not send complete frames
 
-      m_codecContext->flags |= AV_CODEC_FLAG_LOW_DELAY;
+      if (options.lowDelay) {
+         m_codecContext->flags |= AV_CODEC_FLAG_LOW_DELAY;
+      }
+      if (options.light) {
+         m_codecContext->skip_loop_filter = AVDISCARD_ALL;
+         m_codecContext->skip_idct = AVDISCARD_ALL;
+         m_codecContext->flags2 |= AV_CODEC_FLAG2_FAST;
+      }
+      m_codecContext->skip_frame = options.skipFrame;
+      if (options.threading == DecoderThreading::None) {
+         m_codecContext->thread_count = 1;
+      } else {
+         m_codecContext->thread_count = options.threadCount;
+         m_codecContext->thread_type = threadType(options.threading);
+      }
 
       m_codecContext->width = codecParams->width;
       m_codecContext->height = codecParams->height;
@@ -40,6 +80,12 @@ namespace challenge { namespace media {
       m_codecContext->pix_fmt = (AVPixelFormat)codecParams->format;
       
       avcodec_parameters_to_context(m_codecContext, codecParams);
+      m_framePool.Attach(m_codecContext);
+#if LIBAVCODEC_VERSION_MAJOR < 59
+      // the frame pool is thread safe, without this frame threads would wait for each other
+      // to allocate their pictures
+      m_codecContext->thread_safe_callbacks = 1;
+#endif
 
       if (avcodec_open2(m_codecContext, m_codec, nullptr) < 0) {
          spdlog::error("failed to open decoder");
@@ -58,7 +104,9 @@ namespace challenge { namespace media {
       if (!m_avpacket) {
          return false;
       }
-      spdlog::info("decoder opened successfully");
+      spdlog::info("decoder opened successfully ({} threads, thread type {}, low-delay {}, light {})",
+                   m_codecContext->thread_count, m_codecContext->active_thread_type,
+                   options.lowDelay, options.light);
       m_frameCallback = callback;
       m_needToStop = false;
       m_isReady = true;
@@ -74,26 +122,30 @@ namespace challenge { namespace media {
       int ret = 0;
       if (pkt) {
          av_init_packet(m_avpacket);
-         m_avpacket->data = pkt->Data();
+         // the decoder only reads from refcounted packet data
+         m_avpacket->data = const_cast<uint8_t*>(pkt->Data());
          m_avpacket->size = pkt->Size();
          m_avpacket->duration = pkt->Duration();
          m_avpacket->dts = m_avpacket->pts = pkt->PTS();
+         if (pkt->Buffer() != nullptr) {
+            // a refcounted packet lets the decoder keep a reference instead of copying the payload
+            m_avpacket->buf = av_buffer_ref(pkt->Buffer());
+         }
       }
+      const AVPacket* avpacket = pkt ? m_avpacket : nullptr;
 
-      if (pkt) {
-         ret = avcodec_send_packet(m_codecContext, m_avpacket);
-      } else {
-         ret = avcodec_send_packet(m_codecContext, nullptr);
-      }
+      ret = avcodec_send_packet(m_codecContext, avpacket);
       if (ret == AVERROR(EAGAIN)) {
          while (avcodec_receive_frame(m_codecContext, m_avframe) >= 0) {
             handleDecodedFrame();
          }
-         ret = avcodec_send_packet(m_codecContext, m_avpacket);
+         ret = avcodec_send_packet(m_codecContext, avpacket);
       } else if (ret < 0) {
+         av_packet_unref(m_avpacket);
          spdlog::error("media::VideoDecoder >> error while decoding");
          return false;
       }
+      av_packet_unref(m_avpacket);
       while (ret >= 0) {
          ret = avcodec_receive_frame(m_codecContext, m_avframe);
          if (ret == AVERROR_EOF) {
@@ -118,19 +170,12 @@ namespace challenge { namespace media {
       else if (m_avframe->format == AV_PIX_FMT_YUVJ444P)
          m_avframe->format = AV_PIX_FMT_YUV444P;
 
-      // Media::FramePtr coreFrame = Media::Frame::CreateFromAVFrame(decodedFrame);
-      media::FramePtr coreFrame = media::Frame::Create(
-            m_avframe->width, m_avframe->height,
-            AVPixelFormat(m_avframe->format), true);
-      uint8_t* dst[] = {coreFrame->Data(0), coreFrame->Data(1), coreFrame->Data(2), nullptr};
-
-      int dstStride[] = {coreFrame->Stride(0), coreFrame->Stride(1), coreFrame->Stride(2), 0};
-
-      av_image_copy(dst, dstStride, const_cast<const unsigned char**>(m_avframe->data),
-                     m_avframe->linesize, AVPixelFormat(m_avframe->format),
-                     m_avframe->width, m_avframe->height);
-
-      coreFrame->PTS(m_avframe->pts);
+      // hand the decoder's refcounted picture over instead of copying it
+      media::FramePtr coreFrame = media::Frame::CreateFromAVFrame(m_avframe);
+      if (!coreFrame) {
+         spdlog::error("media::VideoDecoder >> failed to wrap decoded frame");
+         return;
+      }
 
       if (!m_needToStop && m_frameCallback) {
          m_frameCallback(coreFrame->ImageWidth(), coreFrame->ImageHeight(), coreFrame);
@@ -2,6 +2,7 @@
 
 
 #include "media/frame.hpp"
+#include "media/frame-pool.hpp"
 #include "media/packet.hpp"
 #include "media/ffmpeg.h"
 #include <functional>
@@ -9,12 +10,33 @@
 namespace challenge { namespace media {
    typedef std::function<void(int width, int height, FramePtr frame)> FrameCallback;
 
+   enum class DecoderThreading { None, Frame, Slice, FrameAndSlice };
+
+   struct DecoderOptions {
+      DecoderThreading threading = DecoderThreading::Slice;
+      int threadCount = 0;  // 0 lets libavcodec pick one thread per core
+      bool lowDelay = true;
+      // skips the loop filter and IDCT: every picture still comes out with its pts and
+      // picture type, but the pixels are garbage, enough to count and validate frames
+      bool light = false;
+      // AVDISCARD_NONREF or higher saves even more, but discarded pictures are never
+      // reported to the FrameCallback
+      AVDiscard skipFrame = AVDISCARD_DEFAULT;
+
+      // frame threading on all cores, the most pictures per second for file analysis
+      // at the cost of a few frames of latency
+      static DecoderOptions Throughput();
+      // slice threading only with low-delay, for live monitoring
+      static DecoderOptions LowLatency();
+   };
+
    class VideoDecoder  {
     public:
       VideoDecoder();
       ~VideoDecoder();
 
-      bool Open(FrameCallback callback, AVCodecParameters* codecParams, AVRational time_base);
+      bool Open(FrameCallback callback, AVCodecParameters* codecParams, AVRational time_base,
+                const DecoderOptions& options = DecoderOptions());
 
       bool Decode(Packet::Ptr& pkt) const;
 
@@ -39,5 +61,7 @@ namespace challenge { namespace media {
       AVCodec* m_codec;
       AVFrame* m_avframe;
       AVPacket* m_avpacket;
+      // the decoder allocates its pictures from here
+      FramePool m_framePool;
    };
 }}  // namespace challenge::media
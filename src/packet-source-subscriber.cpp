@@ -1,11 +1,21 @@
 #include "packet-source-subscriber.hpp"
-#include "common/random-string.hpp"
 #include "packet-source.hpp"
 #include <spdlog/spdlog.h>
 
 namespace challenge { namespace media {
-   PacketSourceSubscriber::PacketSourceSubscriber(int queueSize)
-       : m_isInitialized(true), m_packetQueue(queueSize) {}
+   std::atomic<SubscriberHandle> PacketSourceSubscriber::s_nextHandle(1);
+
+   PacketSourceSubscriber::PacketSourceSubscriber(int queueSize, OverflowPolicy policy,
+                                                  int blockTimeoutMS)
+       : m_isInitialized(true)
+       , m_packetQueue(queueSize)
+       , m_handle(s_nextHandle.fetch_add(1, std::memory_order_relaxed))
+       , m_overflowPolicy(policy)
+       , m_blockTimeoutMS(blockTimeoutMS)
+       , m_waitingForKeyFrame(false)
+       , m_mediaTypes(0)
+       , m_droppedPackets(0)
+       , m_blockedPushes(0) {}
 
    PacketSourceSubscriber::~PacketSourceSubscriber() {
       // if PacketSourceSubscriber destroyed.
@@ -15,23 +25,91 @@ namespace challenge { namespace media {
    }
 
    std::string PacketSourceSubscriber::ObjectId() {
-      if (m_objectId.length() < 10) {
-         // we cant call all the time ObjectName() because it's a virtual function
-         m_objectId = common::randomString();
-         std::string objName = ObjectName();
-         m_objectId = objName.append(m_objectId);
+      if (m_objectId.empty()) {
+         // we cant call ObjectName() in the constructor because it's a virtual function
+         m_objectId = ObjectName().append(std::to_string(m_handle));
       }
       return m_objectId;
    }
 
+   void PacketSourceSubscriber::RequestMediaType(AVMediaType type) {
+      if (type >= 0 && type < AVMEDIA_TYPE_NB) {
+         m_mediaTypes |= 1u << type;
+      }
+   }
+
+   bool PacketSourceSubscriber::WantsMediaType(AVMediaType type) const {
+      if (m_mediaTypes == 0) {
+         return true;
+      }
+      return type >= 0 && type < AVMEDIA_TYPE_NB && (m_mediaTypes & (1u << type)) != 0;
+   }
+
    void PacketSourceSubscriber::NewPacket(Packet::Ptr pkt) {
       if (!pkt || !m_isInitialized)
          return;
-      m_packetQueue.push_front(pkt);
+
+      switch (m_overflowPolicy) {
+         case OverflowPolicy::Block:
+            if (!m_packetQueue.try_push_front(pkt)) {
+               m_blockedPushes++;
+               // a wakeup or a recheck timeout only ends the wait once the subscriber stops,
+               // a wait that starts just after Stop's wakeup still sees the flag in time
+               while (!m_packetQueue.push_front_wait(pkt, BLOCK_RECHECK_MS)) {
+                  if (!m_isInitialized || isStopping()) {
+                     m_droppedPackets++;
+                     break;
+                  }
+               }
+            }
+            break;
+         case OverflowPolicy::BlockWithTimeout:
+            if (!m_packetQueue.try_push_front(pkt)) {
+               m_blockedPushes++;
+               if (!m_packetQueue.push_front_wait(pkt, m_blockTimeoutMS)) {
+                  m_droppedPackets++;
+               }
+            }
+            break;
+         case OverflowPolicy::DropOldest:
+            while (!m_packetQueue.try_push_front(pkt)) {
+               Packet::Ptr oldest;
+               if (m_packetQueue.evict_back(oldest)) {
+                  m_droppedPackets++;
+               }
+            }
+            break;
+         case OverflowPolicy::DropUntilKeyFrame:
+            if (m_waitingForKeyFrame) {
+               if (!pkt->IsKey()) {
+                  m_droppedPackets++;
+                  return;
+               }
+               m_waitingForKeyFrame = false;
+            }
+            if (!m_packetQueue.try_push_front(pkt)) {
+               // without this packet the following ones can not be decoded until the next keyframe
+               m_droppedPackets++;
+               m_waitingForKeyFrame = true;
+            }
+            break;
+      }
    }
 
-   Packet::Ptr PacketSourceSubscriber::ReadPacket() {
-      Packet::Ptr packet = m_packetQueue.pop_back();
-      return std::move(packet);
+   BackpressureStats PacketSourceSubscriber::Backpressure() const {
+      BackpressureStats stats;
+      stats.dropped = m_droppedPackets.load(std::memory_order_relaxed);
+      stats.blocked = m_blockedPushes.load(std::memory_order_relaxed);
+      return stats;
+   }
+
+   Packet::Ptr PacketSourceSubscriber::ReadPacket(int timeoutMS) {
+      Packet::Ptr packet;
+      if (timeoutMS == 0) {
+         m_packetQueue.try_pop_back(packet);
+      } else {
+         m_packetQueue.pop_back_wait(packet, timeoutMS);
+      }
+      return packet;
    }
 }}  // namespace challenge::media
\ No newline at end of file
@@ -1,17 +1,35 @@
 #pragma once
 #include <vector>
 #include <memory>
+#include <atomic>
 #include "media/packet.hpp"
-#include "common/circular-buffer.hpp"
+#include "common/spsc-ring-buffer.hpp"
 
 namespace challenge { namespace media {
    class AVPacketSource;
    typedef std::shared_ptr<AVPacketSource> AVPacketSourcePtr;
    // typedef std::weak_ptr<PacketSource> PacketSourceRef;
 
+   // What NewPacket does when the subscriber's queue is full:
+   // Block waits for the subscriber to read (the source stalls with it),
+   // DropOldest throws away the oldest queued packet,
+   // DropUntilKeyFrame drops the new packet and everything after it up to the next keyframe,
+   // BlockWithTimeout waits like Block but drops the new packet once the timeout is over.
+   enum class OverflowPolicy { Block, DropOldest, DropUntilKeyFrame, BlockWithTimeout };
+
+   struct BackpressureStats {
+      uint64_t dropped;  // packets thrown away by the overflow policy
+      uint64_t blocked;  // times the source had to wait for a free slot
+   };
+
+   // unique for the lifetime of the process, never reused
+   typedef uint64_t SubscriberHandle;
+
    class PacketSourceSubscriber {
     public:
-      explicit PacketSourceSubscriber(int queueSize);
+      explicit PacketSourceSubscriber(int queueSize,
+                                      OverflowPolicy policy = OverflowPolicy::Block,
+                                      int blockTimeoutMS = 100);
 
       virtual ~PacketSourceSubscriber();
 
@@ -19,6 +37,8 @@ namespace challenge { namespace media {
 
       std::string ObjectId();
 
+      SubscriberHandle Handle() const { return m_handle; }
+
       virtual void NewPacket(Packet::Ptr pkt);
 
       void Terminate() { m_isInitialized = false; }
@@ -26,16 +46,47 @@ namespace challenge { namespace media {
 
       virtual bool Setup(const AVPacketSource* source) = 0;
 
-      virtual Packet::Ptr ReadPacket();
+      // called from Setup() for every media type the subscriber wants packets of, the source
+      // discards streams nobody asked for. One that never asks gets everything the source reads
+      void RequestMediaType(AVMediaType type);
+      bool WantsMediaType(AVMediaType type) const;
+
+      // returns the next packet, waiting up to timeoutMS for one to arrive (forever if
+      // negative), or an empty pointer on timeout or WakeReader()
+      virtual Packet::Ptr ReadPacket(int timeoutMS = 0);
+
+      // makes a blocked ReadPacket (or a NewPacket blocked on a full queue) return right away
+      void WakeReader() { m_packetQueue.wakeup(); }
+
+      OverflowPolicy Policy() const { return m_overflowPolicy; }
+
+      BackpressureStats Backpressure() const;
 
     protected:
       virtual void emptyPacketQueue() { m_packetQueue.clear(); }
+      // true once the subscriber is shutting down, only then does a Block push give up
+      virtual bool isStopping() const { return false; }
 
       bool m_isInitialized;
       AVPacketSourcePtr m_packetSource;
 
-      common::CircularBuffer<Packet::Ptr> m_packetQueue;
+      // filled by the packet source thread and drained by the subscriber's own thread
+      common::SpscRingBuffer<Packet::Ptr> m_packetQueue;
       std::string m_objectId;
+
+    private:
+      // how often a Block push checks isStopping() while the queue stays full
+      static const int BLOCK_RECHECK_MS = 100;
+      static std::atomic<SubscriberHandle> s_nextHandle;
+
+      SubscriberHandle m_handle;
+      OverflowPolicy m_overflowPolicy;
+      int m_blockTimeoutMS;
+      bool m_waitingForKeyFrame;
+      // one bit per AVMediaType, 0 when nothing was requested
+      uint32_t m_mediaTypes;
+      std::atomic<uint64_t> m_droppedPackets;
+      std::atomic<uint64_t> m_blockedPushes;
    };
 
    typedef std::shared_ptr<PacketSourceSubscriber> PacketSourceSubscriberPtr;
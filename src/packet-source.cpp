@@ -1,55 +1,278 @@
 #include "packet-source.hpp"
+#include "media/packet-pool.hpp"
 #include <spdlog/spdlog.h>
 #include <algorithm>
 
+extern "C" {
+#include <libavutil/time.h>
+}
+
 namespace challenge { namespace media {
-   AVPacketSource::AVPacketSource()
+   SourceOptions SourceOptions::FastStart() {
+      SourceOptions options;
+      options.probeSize = 256 * 1024;
+      options.analyzeDurationUS = 500000;
+      // we measure the frame-rate ourselves, libavformat does not need to guess it
+      options.fpsProbeSize = 0;
+      return options;
+   }
+
+   AVPacketSource::AVPacketSource(SourceOptions options)
       : m_isStarted(false)
       , m_needToStop(false)
-      , m_lastPktId(0) {}
+      , m_aborted(false)
+      , m_subscribers(std::make_shared<SubscriberList>())
+      , m_subscribersVersion(0)
+      , m_publishVersion(0)
+      , m_options(options)
+      , m_nextPendingPacket(0)
+      , m_validatingCache(false)
+      , m_validationStart(0)
+      , m_lastPktId(0)
+      , m_ioTimeoutMS(DEFAULT_IO_TIMEOUT_MS)
+      , m_ioDeadline(0)
+      , m_lastDataTime(0) {
+      if (!m_options.streamInfoCacheDir.empty()) {
+         m_streamInfoCache.reset(new StreamInfoCache(m_options.streamInfoCacheDir));
+      }
+   }
+
+   AVPacketSource::~AVPacketSource() {
+      Stop();
+   }
 
    bool AVPacketSource::Start(std::string url) {
+      if (!Open(url)) {
+         return false;
+      }
+      m_readThrd.start([&]() { readLoop(); });
+      return true;
+   }
+
+   bool AVPacketSource::Open(std::string url, bool nonBlocking) {
       m_uri = url;
       m_isStarted = false;
+      m_needToStop = false;
+      // after the reset, an Abort() racing with it then always leaves the flag set
+      if (m_aborted) {
+         m_needToStop = true;
+      }
 
       try {
-         m_fmtCtx = avformat_alloc_context();
-         if (avformat_open_input(&m_fmtCtx, m_uri.c_str(), NULL, NULL) < 0) {
-            throw FFmpegException("cannot open url input using libav");
+         openInput(nonBlocking, m_streamInfoCache != nullptr);
+         while (m_validatingCache && !finishCacheValidation()) {
+            if (nonBlocking) {
+               // no data yet, ReadPackets() goes on validating instead of holding the caller
+               return true;
+            }
+            common::async::sleep(1);
+         }
+         setupSubscribers();
+      } catch (std::exception& ex) {
+         spdlog::error(ex.what());
+         avCleanUp();
+         return false;
+      }
+      return true;
+   }
+
+   void AVPacketSource::openInput(bool nonBlocking, bool useCache) {
+      m_fmtCtx = avformat_alloc_context();
+      if (nonBlocking) {
+         m_fmtCtx->flags |= AVFMT_FLAG_NONBLOCK;
+      }
+      m_fmtCtx->interrupt_callback.callback = &AVPacketSource::interruptCallback;
+      m_fmtCtx->interrupt_callback.opaque = this;
+      if (m_options.ioBackend != IOBackend::Default) {
+         m_fileIO = FileIO::Open(m_uri, m_options.ioBackend, m_options.ioBufferSize);
+         if (m_fileIO) {
+            m_fmtCtx->pb = m_fileIO->Context();
+         } else {
+            spdlog::info("reading {} with the default I/O", m_uri);
          }
-         spdlog::info("avformat_open_input successfully");
+      }
+      AVDictionary* formatOptions = nullptr;
+      if (m_options.probeSize > 0) {
+         av_dict_set_int(&formatOptions, "probesize", m_options.probeSize, 0);
+      }
+      if (m_options.analyzeDurationUS > 0) {
+         av_dict_set_int(&formatOptions, "analyzeduration", m_options.analyzeDurationUS, 0);
+      }
+      if (m_options.fpsProbeSize >= 0) {
+         av_dict_set_int(&formatOptions, "fpsprobesize", m_options.fpsProbeSize, 0);
+      }
+      armDeadline();
+      auto ret = avformat_open_input(&m_fmtCtx, m_uri.c_str(), NULL, &formatOptions);
+      av_dict_free(&formatOptions);
+      if (ret < 0) {
+         throw FFmpegException("cannot open url input using libav");
+      }
+      spdlog::info("avformat_open_input successfully");
 
+      bool fromCache = useCache && m_streamInfoCache->Load(m_uri, m_fmtCtx);
+      if (fromCache) {
+         spdlog::info("using cached stream information of {}", m_uri);
+      } else {
          /* retrieve stream information */
+         armDeadline();
          if (avformat_find_stream_info(m_fmtCtx, NULL) < 0) {
             throw FFmpegException("Could not find stream information");
          }
-         video_stream_idx = av_find_best_stream(m_fmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
-         if (video_stream_idx >= 0) {
-            spdlog::info("found video stream: {}", video_stream_idx);
+         if (m_streamInfoCache) {
+            m_streamInfoCache->Save(m_uri, m_fmtCtx);
          }
-         audio_stream_idx = av_find_best_stream(m_fmtCtx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
-         if (audio_stream_idx >= 0) {
-            spdlog::info("found audio stream: {}", audio_stream_idx);
+      }
+      video_stream_idx = av_find_best_stream(m_fmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+      if (video_stream_idx >= 0) {
+         spdlog::info("found video stream: {}", video_stream_idx);
+      }
+      audio_stream_idx = av_find_best_stream(m_fmtCtx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+      if (audio_stream_idx >= 0) {
+         spdlog::info("found audio stream: {}", audio_stream_idx);
+      }
+
+      m_validatingCache = fromCache;
+      m_validationStart = av_gettime_relative();
+   }
+
+   bool AVPacketSource::finishCacheValidation() {
+      auto check = validateCachedStreamInfo();
+      if (check == CacheCheck::Again) {
+         return false;
+      }
+      m_validatingCache = false;
+      if (check == CacheCheck::Failed) {
+         throw FFmpegException("could not check the cached stream information");
+      }
+      if (check == CacheCheck::Stale) {
+         spdlog::warn("cached stream information of {} is stale, probing again", m_uri);
+         bool nonBlocking = (m_fmtCtx->flags & AVFMT_FLAG_NONBLOCK) != 0;
+         m_streamInfoCache->Remove(m_uri);
+         avCleanUp();
+         openInput(nonBlocking, false);
+      }
+      return true;
+   }
+
+   void AVPacketSource::setupSubscribers() {
+      for (auto& sub : *Subscribers()) {
+         if (sub) {
+            sub->Setup(this);
          }
-         for (auto& sub : m_PacketSubscribers) {
-            if (sub) {
-               sub->Setup(this);
+      }
+      discardUnusedStreams();
+   }
+
+   AVPacketSource::CacheCheck AVPacketSource::validateCachedStreamInfo() {
+      if (video_stream_idx < 0) {
+         return CacheCheck::Matches;
+      }
+      auto codecpar = m_fmtCtx->streams[video_stream_idx]->codecpar;
+      while (m_pendingPackets.size() < size_t(MAX_VALIDATION_PACKETS) && !m_needToStop) {
+         auto packet = av_packet_alloc();
+         armDeadline();
+         auto ret = av_read_frame(m_fmtCtx, packet);
+         if (ret == AVERROR(EAGAIN)) {
+            av_packet_free(&packet);
+            auto timeoutMS = m_ioTimeoutMS.load();
+            if (timeoutMS > 0 && av_gettime_relative() - m_validationStart > int64_t(timeoutMS) * 1000) {
+               spdlog::warn("no data from {} for {} ms, giving up", m_uri, timeoutMS);
+               return CacheCheck::Failed;
             }
+            return CacheCheck::Again;
+         }
+         if (ret == AVERROR_EOF) {
+            // ended before a keyframe, nothing contradicts the cache
+            av_packet_free(&packet);
+            return CacheCheck::Matches;
+         }
+         if (ret < 0) {
+            // stopped, past the I/O deadline or a read error, none of it says the cache is wrong
+            av_packet_free(&packet);
+            return CacheCheck::Failed;
          }
+         m_pendingPackets.push_back(packet);
+         if (packet->stream_index == video_stream_idx && (packet->flags & AV_PKT_FLAG_KEY)) {
+            return StreamInfoCache::MatchesKeyFrame(packet, codecpar) ? CacheCheck::Matches
+                                                                      : CacheCheck::Stale;
+         }
+      }
+      // no keyframe yet, nothing contradicts the cache
+      return m_needToStop ? CacheCheck::Failed : CacheCheck::Matches;
+   }
 
-         m_needToStop = false;
+   void AVPacketSource::discardUnusedStreams() {
+      auto subscribers = Subscribers();
+      // nobody to ask yet, keep what the source always published for late subscribers
+      bool wantsVideo = subscribers->empty();
+      bool wantsAudio = subscribers->empty();
+      for (auto& sub : *subscribers) {
+         if (sub) {
+            wantsVideo = wantsVideo || sub->WantsMediaType(AVMEDIA_TYPE_VIDEO);
+            wantsAudio = wantsAudio || sub->WantsMediaType(AVMEDIA_TYPE_AUDIO);
+         }
+      }
+      if (!wantsVideo) {
+         video_stream_idx = -1;
+      }
+      if (!wantsAudio) {
+         audio_stream_idx = -1;
+      }
+      // only the selected video and audio streams are ever published, the demuxer can skip
+      // everything else before it is even copied into a packet
+      int discarded = 0;
+      for (unsigned int i = 0; i < m_fmtCtx->nb_streams; i++) {
+         if (int(i) != video_stream_idx && int(i) != audio_stream_idx) {
+            m_fmtCtx->streams[i]->discard = AVDISCARD_ALL;
+            discarded++;
+         }
+      }
+      if (discarded > 0) {
+         spdlog::info("discarding {} of {} streams", discarded, m_fmtCtx->nb_streams);
+      }
+   }
 
-         m_readThrd.start([&]() { readLoop(); });
-      } catch (std::exception& ex) {
-         spdlog::error(ex.what());
-         avCleanUp();
-         return false;
+   int AVPacketSource::readPacket() {
+      if (m_nextPendingPacket < m_pendingPackets.size()) {
+         auto& pending = m_pendingPackets[m_nextPendingPacket++];
+         av_packet_move_ref(&pkt, pending);
+         av_packet_free(&pending);
+         if (m_nextPendingPacket == m_pendingPackets.size()) {
+            m_pendingPackets.clear();
+            m_nextPendingPacket = 0;
+         }
+         return 0;
       }
-      return true;
+      return av_read_frame(m_fmtCtx, &pkt);
    }
 
    void AVPacketSource::Stop() {
+      // the interrupt callback sees the flag, so this does not wait for a network timeout
       m_needToStop = true;
+      m_readThrd.join();
+      avCleanUp();
+      m_isStarted = false;
+      m_aborted = false;
+   }
+
+   void AVPacketSource::Abort() {
+      m_aborted = true;
+      m_needToStop = true;
+   }
+
+   int AVPacketSource::interruptCallback(void* opaque) {
+      auto source = static_cast<AVPacketSource*>(opaque);
+      if (source->m_needToStop) {
+         return 1;
+      }
+      auto deadline = source->m_ioDeadline.load(std::memory_order_relaxed);
+      return deadline != 0 && av_gettime_relative() > deadline ? 1 : 0;
+   }
+
+   void AVPacketSource::armDeadline() {
+      auto timeoutMS = m_ioTimeoutMS.load(std::memory_order_relaxed);
+      m_ioDeadline.store(timeoutMS > 0 ? av_gettime_relative() + int64_t(timeoutMS) * 1000 : 0,
+                         std::memory_order_relaxed);
    }
 
    const AVStream* AVPacketSource::VideoStream() const {
@@ -67,10 +290,17 @@ namespace challenge { namespace media {
    }
 
    void AVPacketSource::avCleanUp() {
+      for (auto& pending : m_pendingPackets) {
+         av_packet_free(&pending);
+      }
+      m_pendingPackets.clear();
+      m_nextPendingPacket = 0;
+      m_validatingCache = false;
       if (m_fmtCtx != nullptr) {
          avformat_close_input(&m_fmtCtx);
          m_fmtCtx = nullptr;
       }
+      m_fileIO.reset();
 
       video_stream_idx = -1;
       audio_stream_idx = -1;
@@ -80,26 +310,104 @@ namespace challenge { namespace media {
       m_isStarted = true;
       spdlog::info("reading packets started");
       /* read frames from the stream */
-      while (!m_needToStop && av_read_frame(m_fmtCtx, &pkt) >= 0) {
-         Packet::Ptr packet;
-         int64_t pts = 0;
-         if (pkt.stream_index == video_stream_idx) {
-            packet = Packet::CreateFromAVPacket(++m_lastPktId, &pkt, PacketFlags::VideoPacket);
+      while (!m_needToStop) {
+         armDeadline();
+         auto ret = readPacket();
+         if (ret < 0) {
+            if (ret == AVERROR_EXIT && !m_needToStop) {
+               spdlog::warn("no data from {} for {} ms, giving up", m_uri, m_ioTimeoutMS.load());
+            }
+            break;
+         }
+         publishPacket();
+      }
+      m_isStarted = false;
+      // m_needToStop = false;
+   }
+
+   ReadStatus AVPacketSource::ReadPackets(int maxPackets) {
+      if (m_needToStop || m_fmtCtx == nullptr) {
+         return ReadStatus::Ended;
+      }
+      if (m_validatingCache) {
+         // Open() left it to us, the input had no data for the check yet
+         try {
+            if (!finishCacheValidation()) {
+               return ReadStatus::Again;
+            }
+            setupSubscribers();
+         } catch (std::exception& ex) {
+            spdlog::error(ex.what());
+            return ReadStatus::Ended;
+         }
+      }
+      if (!m_isStarted) {
+         m_isStarted = true;
+         m_lastDataTime = av_gettime_relative();
+      }
+      for (int i = 0; i < maxPackets; i++) {
+         if (m_needToStop) {
+            return ReadStatus::Ended;
+         }
+         armDeadline();
+         auto ret = readPacket();
+         if (ret == AVERROR(EAGAIN)) {
+            if (i > 0) {
+               return ReadStatus::Ok;
+            }
+            auto timeoutMS = m_ioTimeoutMS.load();
+            if (timeoutMS > 0 && av_gettime_relative() - m_lastDataTime > int64_t(timeoutMS) * 1000) {
+               spdlog::warn("no data from {} for {} ms, giving up", m_uri, timeoutMS);
+               m_isStarted = false;
+               return ReadStatus::Ended;
+            }
+            return ReadStatus::Again;
+         }
+         if (ret < 0) {
+            if (ret == AVERROR_EXIT && !m_needToStop) {
+               spdlog::warn("no data from {} for {} ms, giving up", m_uri, m_ioTimeoutMS.load());
+            }
+            m_isStarted = false;
+            return ReadStatus::Ended;
+         }
+         m_lastDataTime = av_gettime_relative();
+         publishPacket();
+      }
+      return ReadStatus::Ok;
+   }
+
+   void AVPacketSource::publishPacket() {
+      Packet::Ptr packet;
+      if (pkt.stream_index == video_stream_idx) {
+         packet = Packet::CreateFromAVPacketRef(++m_lastPktId, &pkt, PacketFlags::VideoPacket);
+         if (packet) {
             packet->StreamId(video_stream_idx);
             packet->Duration(pkt.duration);
-         } else if (pkt.stream_index == audio_stream_idx) {
-            // ignoreing audio packet for now
          }
-         if (packet != nullptr) {
-            packet->PTS(pkt.pts);
-            packet->DTS(packet->PTS());
+      } else if (pkt.stream_index == audio_stream_idx) {
+         packet = Packet::CreateFromAVPacketRef(++m_lastPktId, &pkt, PacketFlags::AudioPacket);
+         if (packet) {
+            packet->StreamId(audio_stream_idx);
+            packet->Duration(pkt.duration);
+         }
+      }
+      if (packet != nullptr) {
+         packet->PTS(pkt.pts);
+         packet->DTS(pkt.dts);
 
-            publishToAll(std::move(packet));
+         publishToAll(std::move(packet));
+         if (m_lastPktId % 5000 == 0) {
+            logPoolStats();
          }
-         av_packet_unref(&pkt);
       }
-      m_isStarted = false;
-      // m_needToStop = false;
+      // the published packet holds its own reference to the payload
+      av_packet_unref(&pkt);
+   }
+
+   void AVPacketSource::logPoolStats() const {
+      auto stats = PacketPool::Instance().Stats();
+      spdlog::debug("packet pool: objects {} hits / {} misses, buffers {} hits / {} misses",
+                    stats.packetHits, stats.packetMisses, stats.bufferHits, stats.bufferMisses);
    }
 
    void AVPacketSource::Subscribe(PacketSourceSubscriberPtr subscriber) {
@@ -109,67 +417,118 @@ namespace challenge { namespace media {
          return;
 
       std::unique_lock<std::mutex> lock(m_mtx);
-      removeTerminatedPacketSource();
-      auto res = std::find_if(
-          m_PacketSubscribers.begin(), m_PacketSubscribers.end(),
-          [&](auto elemntPtr) { return subscriber->ObjectId() == elemntPtr->ObjectId(); });
-      if (res == m_PacketSubscribers.end()) {
-         m_PacketSubscribers.push_back(subscriber);
-      }
+      removeTerminated();
+      m_subscriberMap.emplace(subscriber->Handle(), subscriber);
+      publishSubscribers();
       onSubscribed(subscriber);
    }
 
    void AVPacketSource::Unsubscribe(PacketSourceSubscriberPtr subscriber) {
-      if (m_needToStop)
-         return;
       if (!subscriber)
          return;
+      Unsubscribe(subscriber->Handle());
+   }
+
+   void AVPacketSource::Unsubscribe(SubscriberHandle handle) {
+      if (m_needToStop)
+         return;
 
       std::unique_lock<std::mutex> lock(m_mtx);
-      auto res = std::find_if(
-          m_PacketSubscribers.begin(), m_PacketSubscribers.end(),
-          [&](auto elementPtr) { return subscriber->ObjectId() == elementPtr->ObjectId(); });
-      if (res != m_PacketSubscribers.end()) {
-         m_PacketSubscribers.erase(res);
+      PacketSourceSubscriberPtr subscriber;
+      auto res = m_subscriberMap.find(handle);
+      if (res != m_subscriberMap.end()) {
+         subscriber = res->second;
+         m_subscriberMap.erase(res);
       }
-      removeTerminatedPacketSource();
-      onUnsubscribed(subscriber);
+      removeTerminated();
+      publishSubscribers();
+      if (subscriber) {
+         onUnsubscribed(subscriber);
+      }
+   }
+
+   AVPacketSource::SubscriberListPtr AVPacketSource::Subscribers() const {
+      return std::atomic_load(&m_subscribers);
    }
 
    void AVPacketSource::publishToAll(Packet::Ptr pkt) {
       if (m_needToStop || !m_isStarted)
          return;
-      std::unique_lock<std::mutex> lock(m_mtx);
-      removeTerminatedPacketSource();
-      if (m_PacketSubscribers.size() == 1) {
-         auto& subscriberPtr = m_PacketSubscribers.front();
-         if (subscriberPtr && !subscriberPtr->IsTerminated()) {
+
+      // the list only changes on (un)subscribe, so most packets get away with one atomic load
+      auto version = m_subscribersVersion.load(std::memory_order_acquire);
+      if (version != m_publishVersion || !m_publishSnapshot) {
+         m_publishSnapshot = Subscribers();
+         m_publishVersion = version;
+      }
+      const auto& subscribers = *m_publishSnapshot;
+
+      // subscribers only get the media types they asked for
+      auto mediaType = pkt->HasFlag(PacketFlags::AudioPacket) ? AVMEDIA_TYPE_AUDIO : AVMEDIA_TYPE_VIDEO;
+      auto receives = [mediaType](const PacketSourceSubscriberPtr& subscriber) {
+         return subscriber && !subscriber->IsTerminated() && subscriber->WantsMediaType(mediaType);
+      };
+
+      // every subscriber gets its own metadata over the same payload,
+      // the last receiving one takes the original packet
+      int last = int(subscribers.size()) - 1;
+      while (last >= 0 && !receives(subscribers[last])) {
+         last--;
+      }
+      bool hasTerminated = false;
+      for (int i = 0; i < int(subscribers.size()); i++) {
+         if (m_needToStop)
+            return;
+         auto& subscriberPtr = subscribers[i];
+         if (!subscriberPtr || subscriberPtr->IsTerminated()) {
+            hasTerminated = true;
+            continue;
+         }
+         if (i > last || !subscriberPtr->WantsMediaType(mediaType)) {
+            continue;
+         }
+         if (i == last) {
             subscriberPtr->NewPacket(std::move(pkt));
          } else {
-            m_PacketSubscribers.clear();
-         }
-      } else {
-         for (auto& subscriberPtr : m_PacketSubscribers) {
-            if (m_needToStop)
-               return;
-            if (subscriberPtr && !subscriberPtr->IsTerminated()) {
-               auto clonedPkt = pkt->Clone();
-               subscriberPtr->NewPacket(std::move(clonedPkt));
-            } else {
-               // remove
-            }
+            subscriberPtr->NewPacket(pkt->Clone());
          }
       }
+      if (hasTerminated) {
+         removeTerminatedPacketSource();
+      }
    }
 
    void AVPacketSource::removeTerminatedPacketSource() {
-      auto iter = m_PacketSubscribers.begin();
-      while (iter != m_PacketSubscribers.end()) {
-         if ((*iter)->IsTerminated()) {
-            m_PacketSubscribers.erase(iter++);
+      std::unique_lock<std::mutex> lock(m_mtx);
+      if (removeTerminated()) {
+         publishSubscribers();
+      }
+   }
+
+   bool AVPacketSource::removeTerminated() {
+      bool removed = false;
+      auto iter = m_subscriberMap.begin();
+      while (iter != m_subscriberMap.end()) {
+         if (!iter->second || iter->second->IsTerminated()) {
+            iter = m_subscriberMap.erase(iter);
+            removed = true;
          } else {
             ++iter;
          }
       }
+      return removed;
+   }
+
+   void AVPacketSource::publishSubscribers() {
+      auto subscribers = std::make_shared<SubscriberList>();
+      subscribers->reserve(m_subscriberMap.size());
+      for (auto& entry : m_subscriberMap) {
+         subscribers->push_back(entry.second);
+      }
+      // keep the order subscribers joined in
+      std::sort(subscribers->begin(), subscribers->end(),
+                [](auto& a, auto& b) { return a->Handle() < b->Handle(); });
+      std::atomic_store(&m_subscribers, SubscriberListPtr(std::move(subscribers)));
+      m_subscribersVersion.fetch_add(1, std::memory_order_release);
    }
 }}  // namespace challenge::media
\ No newline at end of file
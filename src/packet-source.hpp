@@ -2,17 +2,65 @@
 #include "media/ffmpeg.h"
 #include "common/thread.hpp"
 #include "packet-source-subscriber.hpp"
+#include "media/stream-info-cache.hpp"
+#include "media/file-io.hpp"
+#include <atomic>
+#include <memory>
 #include <mutex>
-#include <list>
+#include <unordered_map>
+#include <vector>
 
 namespace challenge { namespace media {
+   // result of one ReadPackets() step
+   enum class ReadStatus { Ok, Again, Ended };
+
+   struct SourceOptions {
+      // how much input avformat_open_input/find_stream_info may look at before the first packet,
+      // 0 (or -1 for fpsProbeSize) keeps libavformat's defaults of 5MB and 5 seconds
+      int64_t probeSize = 0;
+      int64_t analyzeDurationUS = 0;
+      int fpsProbeSize = -1;
+      // where codec parameters are remembered per uri to skip find_stream_info on the next
+      // start, empty disables the cache
+      std::string streamInfoCacheDir;
+      // how local files are read, other inputs always use libavformat's own protocols
+      IOBackend ioBackend = IOBackend::Default;
+      int ioBufferSize = FileIO::DEFAULT_BUFFER_SIZE;
+
+      // small probes for live inputs that send parameter sets with every keyframe
+      static SourceOptions FastStart();
+   };
+
    class AVPacketSource {
     public:
-      AVPacketSource();
-      virtual ~AVPacketSource() {}
+      typedef std::vector<PacketSourceSubscriberPtr> SubscriberList;
+      typedef std::shared_ptr<const SubscriberList> SubscriberListPtr;
+
+      AVPacketSource(SourceOptions options = SourceOptions());
+      virtual ~AVPacketSource();
 
+      // opens the input and reads it on a thread of its own
       virtual bool Start(std::string uri);
+      // aborts any I/O in progress, waits for the reading thread and closes the input,
+      // the source can be started again afterwards
       virtual void Stop();
+      // makes blocking I/O in progress return and every later step end without waiting for
+      // anything, Stop() still has to follow. Safe from any thread
+      void Abort();
+
+      // I/O that has not returned after this long is aborted and ends the stream,
+      // 0 leaves it to the protocol's own timeouts
+      void IOTimeout(int timeoutMS) {
+         m_ioTimeoutMS = timeoutMS;
+      }
+
+      // opens the input and sets the subscribers up without starting a thread, the caller then
+      // drives the source with ReadPackets(). nonBlocking asks the demuxer to return instead of
+      // waiting for data where the protocol supports it
+      virtual bool Open(std::string uri, bool nonBlocking = false);
+      // reads and publishes up to maxPackets packets. Again means no data was available yet,
+      // Ended means the input is finished or the source was stopped
+      ReadStatus ReadPackets(int maxPackets);
 
       std::string Uri() const {
          return m_uri;
@@ -27,6 +75,10 @@ namespace challenge { namespace media {
 
       void Subscribe(PacketSourceSubscriberPtr subscriber);
       void Unsubscribe(PacketSourceSubscriberPtr subscriber);
+      void Unsubscribe(SubscriberHandle handle);
+
+      // an immutable snapshot of the current subscribers
+      SubscriberListPtr Subscribers() const;
 
     protected:
       virtual void publishToAll(Packet::Ptr pkt);
@@ -35,22 +87,83 @@ namespace challenge { namespace media {
 
       void removeTerminatedPacketSource();
 
-      std::list<PacketSourceSubscriberPtr> m_PacketSubscribers;
-
       std::string m_uri;
-      bool m_isStarted;
-      bool m_needToStop;
+      std::atomic<bool> m_isStarted;
+      std::atomic<bool> m_needToStop;
+      // set by Abort() until the next Stop(), Open() does not clear it like m_needToStop
+      std::atomic<bool> m_aborted;
 
    private:
+      // AVIOInterruptCB, makes blocking libav calls return once we stop or the deadline passed
+      static int interruptCallback(void* opaque);
+      // starts the deadline for the next blocking libav call
+      void armDeadline();
+
+      // Failed means the check could not finish (stop, timeout, read error), the entry is kept
+      enum class CacheCheck { Matches, Stale, Failed, Again };
+
+      // opens m_uri and finds its streams, from the cache when allowed, throws on failure.
+      // Cached parameters still have to pass finishCacheValidation()
+      void openInput(bool nonBlocking, bool useCache);
+      // reads up to the first video keyframe into m_pendingPackets and checks the cached
+      // parameters against it, Again when a non-blocking input has no data yet
+      CacheCheck validateCachedStreamInfo();
+      // probes the input again when the cache was stale, false while validation waits for
+      // data. Throws when the check failed or the input can not be opened again
+      bool finishCacheValidation();
+      // Setup() of every subscriber once the streams are known
+      void setupSubscribers();
+      // av_read_frame into pkt, handing out what validateCachedStreamInfo() read ahead first
+      int readPacket();
+
+      // sets AVDISCARD_ALL on every stream no subscriber wants, after they were set up
+      void discardUnusedStreams();
+
       void readLoop();
+      // wraps and publishes the packet av_read_frame just filled in
+      void publishPacket();
       void avCleanUp();
+      void logPoolStats() const;
 
+      // drops terminated subscribers from m_subscriberMap, m_mtx must be held
+      bool removeTerminated();
+      // rebuilds the published list from m_subscriberMap, m_mtx must be held
+      void publishSubscribers();
+
+      // only serializes writers, publishToAll reads the list without it
       std::mutex m_mtx;
+      std::unordered_map<SubscriberHandle, PacketSourceSubscriberPtr> m_subscriberMap;
+      // copy-on-write, a new list is swapped in atomically on every change
+      SubscriberListPtr m_subscribers;
+      std::atomic<uint64_t> m_subscribersVersion;
+      // only touched by the reading thread
+      SubscriberListPtr m_publishSnapshot;
+      uint64_t m_publishVersion;
+
+      SourceOptions m_options;
+      std::unique_ptr<StreamInfoCache> m_streamInfoCache;
+      // outlives m_fmtCtx, libavformat does not free a custom AVIOContext
+      std::unique_ptr<FileIO> m_fileIO;
+      std::vector<AVPacket*> m_pendingPackets;
+      size_t m_nextPendingPacket;
+      // cached parameters not checked yet, ReadPackets() keeps validating before it reads
+      bool m_validatingCache;
+      int64_t m_validationStart;
 
       AVFormatContext* m_fmtCtx = nullptr;
       int video_stream_idx = -1, audio_stream_idx = -1;
       AVPacket pkt;
       int64_t m_lastPktId;
       common::async::Thread m_readThrd;
+
+      static const int DEFAULT_IO_TIMEOUT_MS = 10000;
+      std::atomic<int> m_ioTimeoutMS;
+      // av_gettime_relative() microseconds, 0 when there is none
+      std::atomic<int64_t> m_ioDeadline;
+      // when ReadPackets() last got data, a non-blocking read never hits the deadline
+      int64_t m_lastDataTime;
+
+      // packets read while looking for the keyframe that validates the cache
+      static const int MAX_VALIDATION_PACKETS = 1000;
    };
 }}
\ No newline at end of file
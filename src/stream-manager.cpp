@@ -0,0 +1,170 @@
+#include "stream-manager.hpp"
+#include <spdlog/spdlog.h>
+
+namespace challenge { namespace media {
+
+   StreamManager::StreamManager(common::async::ExecutorPtr executor, common::async::ExecutorPtr ioExecutor,
+                                int durationMS, CountingMode mode, DecoderOptions decoderOptions,
+                                SourceOptions sourceOptions)
+      : m_executor(executor)
+      , m_ioExecutor(ioExecutor ? ioExecutor : executor)
+      , m_durationMS(durationMS)
+      , m_mode(mode)
+      , m_decoderOptions(decoderOptions)
+      , m_sourceOptions(sourceOptions)
+      , m_needToStop(false)
+      , m_pendingTasks(0)
+      , m_timerGuard(std::make_shared<TimerGuard>()) {
+      post(m_executor, [this]() { report(); }, m_durationMS);
+   }
+
+   StreamManager::~StreamManager() {
+      Stop();
+   }
+
+   void StreamManager::Add(const std::string& uri) {
+      if (m_needToStop) {
+         return;
+      }
+      auto stream = std::make_shared<Stream>();
+      stream->uri = uri;
+      stream->isRunning = false;
+      stream->source.reset(new AVPacketSource(m_sourceOptions));
+      // the step drains the queue right after reading, it never fills up
+      stream->counter = std::make_shared<FrameCounter>(m_durationMS, m_mode, OverflowPolicy::Block,
+                                                       m_decoderOptions);
+      stream->source->Subscribe(stream->counter);
+      {
+         std::unique_lock<std::mutex> lock(m_mtx);
+         m_streams.push_back(stream);
+      }
+      post(m_ioExecutor, [this, stream]() { open(stream); });
+   }
+
+   void StreamManager::Stop() {
+      m_needToStop = true;
+      {
+         // a step blocked in libav returns through the source's interrupt callback
+         std::unique_lock<std::mutex> lock(m_mtx);
+         for (auto& stream : m_streams) {
+            stream->source->Abort();
+         }
+      }
+      {
+         std::unique_lock<std::mutex> lock(m_timerGuard->mtx);
+         m_timerGuard->isAlive = false;
+      }
+      std::vector<StreamPtr> streams;
+      {
+         std::unique_lock<std::mutex> lock(m_mtx);
+         m_tasksDone.wait(lock, [this]() { return m_pendingTasks == 0; });
+         streams.swap(m_streams);
+      }
+      for (auto& stream : streams) {
+         stream->isRunning = false;
+         stream->source->Unsubscribe(stream->counter);
+         stream->counter->Stop();
+         stream->source->Stop();
+      }
+   }
+
+   std::vector<StreamStats> StreamManager::Stats() const {
+      std::vector<StreamStats> stats;
+      std::unique_lock<std::mutex> lock(m_mtx);
+      stats.reserve(m_streams.size());
+      for (auto& stream : m_streams) {
+         stats.push_back(StreamStats{stream->uri, stream->isRunning, stream->counter->FPS(),
+                                     stream->counter->Jitter()});
+      }
+      return stats;
+   }
+
+   void StreamManager::open(StreamPtr stream) {
+      if (m_needToStop) {
+         return;
+      }
+      if (!stream->source->Open(stream->uri, true)) {
+         spdlog::error("could not open {}", stream->uri);
+         return;
+      }
+      stream->isRunning = true;
+      readStep(stream);
+   }
+
+   void StreamManager::readStep(StreamPtr stream) {
+      if (m_needToStop) {
+         return;
+      }
+      auto status = stream->source->ReadPackets(READ_BATCH);
+      post(m_executor, [this, stream, status]() { countStep(stream, status); });
+   }
+
+   void StreamManager::countStep(StreamPtr stream, ReadStatus status) {
+      if (m_needToStop) {
+         return;
+      }
+      stream->counter->ProcessPackets(QUEUE_SIZE);
+      switch (status) {
+         case ReadStatus::Ok:
+            post(m_ioExecutor, [this, stream]() { readStep(stream); });
+            break;
+         case ReadStatus::Again:
+            post(m_ioExecutor, [this, stream]() { readStep(stream); }, IDLE_DELAY_MS);
+            break;
+         case ReadStatus::Ended:
+            spdlog::info("{} ended", stream->uri);
+            stream->isRunning = false;
+            break;
+      }
+   }
+
+   void StreamManager::report() {
+      if (m_needToStop) {
+         return;
+      }
+      for (auto& stats : Stats()) {
+         if (stats.isRunning) {
+            spdlog::info("{}: frame-rate {:.2f}, interval p95 {:.1f} ms", stats.uri, stats.fps,
+                         stats.jitter.p95);
+         }
+      }
+      post(m_executor, [this]() { report(); }, m_durationMS);
+   }
+
+   void StreamManager::post(const common::async::ExecutorPtr& executor, common::async::Executor::Task task,
+                            int delayMS) {
+      if (delayMS > 0) {
+         auto guard = m_timerGuard;
+         executor->PostAfter(delayMS, [this, guard, task]() {
+            {
+               std::unique_lock<std::mutex> guardLock(guard->mtx);
+               if (!guard->isAlive) {
+                  return;
+               }
+               std::unique_lock<std::mutex> lock(m_mtx);
+               m_pendingTasks++;
+            }
+            runCounted(task);
+         });
+         return;
+      }
+      {
+         std::unique_lock<std::mutex> lock(m_mtx);
+         m_pendingTasks++;
+      }
+      executor->Post([this, task]() { runCounted(task); });
+   }
+
+   void StreamManager::runCounted(const common::async::Executor::Task& task) {
+      try {
+         task();
+      } catch (std::exception& ex) {
+         spdlog::error(ex.what());
+      }
+      std::unique_lock<std::mutex> lock(m_mtx);
+      if (--m_pendingTasks == 0) {
+         m_tasksDone.notify_all();
+      }
+   }
+
+}}  // namespace challenge::media
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "common/executor.hpp"
+#include "frame-coutner.hpp"
+#include "packet-source.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace challenge { namespace media {
+
+   struct StreamStats {
+      std::string uri;
+      bool isRunning;
+      double fps;
+      JitterStats jitter;
+   };
+
+   // Counts the frame-rate of many inputs on a shared executor instead of two threads each.
+   // Every stream is a chain of small steps: read a batch of packets on ioExecutor, count them on
+   // executor, post the next read. Only one step of a stream is in flight at a time, so a source
+   // and its counter are never touched by two workers at once.
+   // Opening and reading go to ioExecutor because libav may block in them: a stream with no data
+   // waits on a timer only when its protocol honors the non-blocking flag, most network protocols
+   // do not and hold their I/O thread until data arrives or the source's I/O timeout passes.
+   // Stalled inputs can therefore use up ioExecutor (size it for the inputs that may stall at
+   // once), but never the counting workers.
+   class StreamManager {
+    public:
+      // the default I/O thread count is one per input up to this
+      static const int MAX_IO_THREADS = 32;
+
+      StreamManager(common::async::ExecutorPtr executor, common::async::ExecutorPtr ioExecutor,
+                    int durationMS,
+                    CountingMode mode = CountingMode::Decode,
+                    DecoderOptions decoderOptions = DecoderOptions(),
+                    SourceOptions sourceOptions = SourceOptions());
+      ~StreamManager();
+
+      // opens the input on the I/O executor and starts counting it
+      void Add(const std::string& uri);
+
+      // stops every stream and waits for their in-flight steps, call it before the executors
+      // are stopped since a dropped step would be waited for forever
+      void Stop();
+
+      std::vector<StreamStats> Stats() const;
+
+    private:
+      // packets read per step, must stay below the counter's queue size since the step
+      // drains the queue only after reading
+      static const int READ_BATCH = 16;
+      static const int QUEUE_SIZE = 50;
+      // how long an idle stream waits before it polls again
+      static const int IDLE_DELAY_MS = 5;
+
+      struct Stream {
+         std::string uri;
+         std::unique_ptr<AVPacketSource> source;
+         std::shared_ptr<FrameCounter> counter;
+         std::atomic<bool> isRunning;
+      };
+      typedef std::shared_ptr<Stream> StreamPtr;
+
+      void open(StreamPtr stream);
+      // on the I/O executor, hands what it read to countStep
+      void readStep(StreamPtr stream);
+      // on the counting executor, schedules the next read
+      void countStep(StreamPtr stream, ReadStatus status);
+      void report();
+      // counted posts, Stop() waits until all of them have finished. A delayed one is only
+      // counted once it fires, so Stop() does not sit out a pending report or backoff timer
+      void post(const common::async::ExecutorPtr& executor, common::async::Executor::Task task,
+                int delayMS = 0);
+      void runCounted(const common::async::Executor::Task& task);
+
+      StreamManager(const StreamManager&) = delete;
+      StreamManager& operator=(const StreamManager&) = delete;
+
+      common::async::ExecutorPtr m_executor;
+      common::async::ExecutorPtr m_ioExecutor;
+      int m_durationMS;
+      CountingMode m_mode;
+      DecoderOptions m_decoderOptions;
+      SourceOptions m_sourceOptions;
+      std::atomic<bool> m_needToStop;
+
+      mutable std::mutex m_mtx;
+      std::vector<StreamPtr> m_streams;
+      int m_pendingTasks;
+      std::condition_variable m_tasksDone;
+
+      // shared with the timers still queued in the executor, they may fire after we are gone
+      struct TimerGuard {
+         std::mutex mtx;
+         bool isAlive = true;
+      };
+      std::shared_ptr<TimerGuard> m_timerGuard;
+   };
+
+}}  // namespace challenge::media